@@ -1,9 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <string.h>
 #include <errno.h>
 #include <elf.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /*
  * Special macros
@@ -11,23 +20,264 @@
 
 #define ELFCONF_SECTION_SYMTAB  ".symtab"
 #define ELFCONF_SECTION_STRTAB  ".strtab"
+#define ELFCONF_SECTION_DYNSYM  ".dynsym"
+#define ELFCONF_SECTION_DYNSTR  ".dynstr"
+#define ELFCONF_SECTION_DYNAMIC ".dynamic"
+#define ELFCONF_SECTION_BUILDID ".note.gnu.build-id"
+
+/* Checksum types, in the order in which they are updated */
+#define ELFCONF_CHECKSUM_CRC32    1
+#define ELFCONF_CHECKSUM_SHA256   2
+#define ELFCONF_CHECKSUM_BUILDID  3
+
+/* Evaluation state of values */
+#define ELFCONF_VALUE_PENDING    0
+#define ELFCONF_VALUE_EVALUATING 1
+#define ELFCONF_VALUE_DONE       2
+
+/* Types of values */
+#define ELFCONF_TYPE_UNSIGNED    0
+#define ELFCONF_TYPE_SIGNED      1
+#define ELFCONF_TYPE_FLOAT       2
+#define ELFCONF_TYPE_STRING      3
+
+/* Fill patterns are replicated in chunks of at most this size */
+#define ELFCONF_FILL_CHUNK       (256 * 1024)
+
+/* Granularity of the cached SHA-256 midstates */
+#define ELFCONF_CHECKSUM_BLOCK  (64 * 1024)
+
+#define ELFCONF_CACHE_SUFFIX    ".elfconf-cache"
+#define ELFCONF_CACHE_MAGIC     "ELFCSUM2"
+
+/* Policies for symbols defined in more than one object */
+#define ELFCONF_DUPLICATES_ERROR 0
+#define ELFCONF_DUPLICATES_FIRST 1
+#define ELFCONF_DUPLICATES_ALL   2
+
+/* Number of locks guarding the symbol index */
+#define ELFCONF_INDEX_PARTITIONS 64
+
+/* Headers are read in host byte order */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define ELFCONF_HOST_DATA       ELFDATA2MSB
+#else
+#define ELFCONF_HOST_DATA       ELFDATA2LSB
+#endif
 
 /*
  * Structures and typedefs
  */
 
+struct elfconf_patch {
+	size_t offset;
+	size_t size;
+	/* Bytes at offset before they were overwritten */
+	unsigned char *old;
+	struct elfconf_patch *next;
+};
+
+struct elfconf_checksum {
+	int type;
+	/*
+	 * Arguments from command line: the section to be hashed and
+	 * the symbol (crc32) or note section (sha256) receiving the
+	 * digest. Both are unused for the build-id.
+	 */
+	char *section;
+	char *target;
+	/*
+	 * Resolved file offsets of the hashed range and of the digest
+	 * within the ELF. The digest bytes are hashed as zeroes.
+	 */
+	size_t offset;
+	size_t size;
+	size_t hoff;
+	size_t hsize;
+	/*
+	 * Digest and SHA-256 midstates at the start of each block of
+	 * the hashed range, kept in the checksum cache.
+	 */
+	unsigned char digest[32];
+	uint32_t *states;
+	size_t numstates;
+	struct elfconf_checksum *next;
+};
+
+/*
+ * Symbol, member of a symbol or section referenced by name
+ */
+struct elfconf_object {
+	unsigned long addr;
+	unsigned long offset;
+	unsigned long size;
+	/* Size of array elements, 0 if unknown */
+	unsigned long elem_size;
+	/* Bitfield members, bit_offset counts from the LSB (MSB for big-endian) */
+	unsigned int bit_offset;
+	unsigned int bit_size;
+	int section;
+	/* Value and binding of the symbol, to find its debug information */
+	unsigned long symaddr;
+	int bind;
+	/* Contents in the ELF buffer, NULL if not present in the file */
+	void *data;
+};
+
+struct elfconf_value {
+	/*
+	 * Symbol, value expression and how to store it from command line
+	 */
+	char *sym;
+	char *expr;
+	int type;
+	unsigned int width;
+	int fill;
+	/*
+	 * Evaluated value, see ELFCONF_VALUE_* for the state
+	 */
+	unsigned long val;
+	int state;
+	/*
+	 * Location of the symbol and bytes to be written there. Objects
+	 * found by searching may also have a local symbol of that name.
+	 */
+	int exported;
+	struct elfconf_object obj;
+	unsigned char *data;
+	size_t size;
+	struct elfconf_value *next;
+};
+
+struct elfconf_arguments;
+
+struct elfconf_expr {
+	struct elfconf_arguments *args;
+	void *elf;
+	int (*lookup)(struct elfconf_arguments *args, void *elf, char *name, struct elfconf_object *obj);
+	/* Current position in the expression */
+	char *pos;
+	/* Value being evaluated, its own symbol refers to the ELF contents */
+	struct elfconf_value *value;
+};
+
+struct elfconf_dwarf_section {
+	const unsigned char *data;
+	size_t size;
+};
+
+struct elfconf_dwarf_abbrev {
+	unsigned long code;
+	unsigned long tag;
+	int children;
+	/* Attribute specifications */
+	const unsigned char *specs;
+};
+
+struct elfconf_dwarf_abbrevs {
+	unsigned long offset;
+	struct elfconf_dwarf_abbrev *decls;
+	size_t count;
+	struct elfconf_dwarf_abbrevs *next;
+};
+
+struct elfconf_debug {
+	/*
+	 * Mapping of a separate debug or .dwo file, NULL for the ELF
+	 */
+	char *path;
+	void *map;
+	size_t mapsize;
+	int msb;
+	int dwo;
+	/*
+	 * DWARF sections (with .dwo suffix in split DWARF files)
+	 */
+	struct elfconf_dwarf_section info;
+	struct elfconf_dwarf_section abbrev;
+	struct elfconf_dwarf_section str;
+	struct elfconf_dwarf_section str_offsets;
+	struct elfconf_dwarf_section line_str;
+	struct elfconf_dwarf_section names;
+	struct elfconf_dwarf_section gdb_index;
+	/*
+	 * Abbreviation tables parsed so far and loaded .dwo files
+	 */
+	struct elfconf_dwarf_abbrevs *abbrevs;
+	struct elfconf_debug *dwos;
+};
+
+struct elfconf_definition {
+	/* Object defining the symbol, in load order */
+	size_t file;
+	int bind;
+	struct elfconf_definition *next;
+};
+
+struct elfconf_name {
+	char *name;
+	size_t len;
+	uint32_t hash;
+	/* Definitions found so far, sorted by load order */
+	struct elfconf_definition *defs;
+};
+
+struct elfconf_search {
+	/*
+	 * Objects in load order and a hash table of their paths
+	 */
+	char **files;
+	size_t numfiles;
+	size_t maxfiles;
+	size_t *table;
+	size_t numtable;
+	/*
+	 * Requested symbol names, hashed with open addressing. Each lock
+	 * guards the definitions of the names in one partition of the hash.
+	 */
+	struct elfconf_name *names;
+	size_t numnames;
+	pthread_mutex_t locks[ELFCONF_INDEX_PARTITIONS];
+	/*
+	 * Next object to be indexed and first error, shared by all threads
+	 */
+	size_t next;
+	int error;
+};
+
 struct elfconf_arguments {
 	/*
 	 * Arguments from command line
 	 */
 	char *elf;
-	char *sym;
-	unsigned long val;
+	struct elfconf_value *values;
+	struct elfconf_checksum *csums;
+	/*
+	 * Directories searched for the objects defining the symbols
+	 */
+	char **paths;
+	size_t numpaths;
+	int needed;
+	int duplicates;
+	/* Set while an object found in the search paths is configured */
+	struct elfconf_search *search;
 	/*
-	 * FILE pointer and ELF buffer
+	 * FILE pointer and private mapping of the ELF, pages are only
+	 * copied when written
 	 */
 	FILE *efp;
 	void *buf;
+	size_t size;
+	struct stat est;
+	/*
+	 * Debug information, loaded on first use
+	 */
+	struct elfconf_debug *debug;
+	int nodebug;
+	/*
+	 * Modifications made to the ELF buffer
+	 */
+	struct elfconf_patch *patches;
 };
 
 struct elfconf_ehdr {
@@ -46,6 +296,7 @@ struct elfconf_elf32file {
 	Elf32_Sym *symtab;
 	unsigned int numsyms;
 	char *strtab;
+	unsigned int strsize;
 	char *shstrtab;
 };
 
@@ -58,6 +309,7 @@ struct elfconf_elf64file {
 	Elf64_Sym *symtab;
 	unsigned int numsyms;
 	char *strtab;
+	unsigned int strsize;
 	char *shstrtab;
 };
 
@@ -66,6 +318,11 @@ struct elfconf_elf64file {
  */
 
 #ifdef ELFCONF_DEBUG
+/* Not defined by older versions of <elf.h> */
+#ifndef EM_ARC_COMPACT2
+#define EM_ARC_COMPACT2 195
+#endif
+
 static const char *ehdr_class[] = {
 		"(invalid)",
 		"32-bit",
@@ -352,7 +609,13 @@ static const char *symbol_info_type[] = {
 #endif
 
 static void print_elfconf_info(char *name) {
-	printf("Usage: %s {-h | -f <filename> -s <symbol> -v <value>}\n", name);
+	printf("Usage: %s {-h | -f <filename> {-s <symbol> -v <value> [<store options>]}... [-c <checksum>]...}\n", name);
+	printf("Symbols: <symbol> or <symbol>.<member>[<index>]... (requires DWARF)\n");
+	printf("Values: C expressions with sizeof(<name>), offset(<name>), addr(<name>),\n"
+		   "        align(<x>, <n>) and the values of other symbols, or {<value>, ...}\n");
+	printf("Store options: -w 1|2|4|8|16 -t unsigned|signed|float|string -F (fill)\n");
+	printf("Checksums: crc32:<section>:<symbol> | sha256:<section>:<note> | build-id\n");
+	printf("Search: -S <dir>[:<dir>]... [-N] [-D error|first|all], with or without -f\n");
 }
 
 static void print_elfconf_ehdr(char *name, struct elfconf_ehdr *ehdr) {
@@ -441,297 +704,5017 @@ static inline void *elf_offset(struct elfconf_arguments *args, unsigned long off
 	return args->buf + offset;
 }
 
+static void free_elfconf_debug(struct elfconf_debug *debug);
+
 static void clear_elfconf_file(struct elfconf_arguments *args) {
+	struct elfconf_patch *patch;
+	struct elfconf_checksum *csum;
+
 	if (args->efp)
 		fclose(args->efp);
 
 	if (args->buf)
-		free(args->buf);
+		munmap(args->buf, args->size);
+
+	free_elfconf_debug(args->debug);
+	args->debug = NULL;
+
+	while ((patch = args->patches)) {
+		args->patches = patch->next;
+		free(patch->old);
+		free(patch);
+	}
+
+	for (csum = args->csums; csum; csum = csum->next) {
+		free(csum->states);
+		csum->states = NULL;
+		csum->numstates = 0;
+	}
+
+	args->efp = NULL;
+	args->buf = NULL;
 }
 
-/*
- * 32-bit ELF functions
- */
+static int write_elfconf_file(struct elfconf_arguments *args, size_t offset,
+		const void *data, size_t size) {
+	struct elfconf_patch *patch, *prev, **pos;
+	size_t start = offset, end = offset + size;
+	int merged;
 
-static void *find_elf32_section(struct elfconf_elf32file *elf, char *name, unsigned int *num) {
-	Elf32_Shdr *section;
-	unsigned int shndx;
+	if (offset > args->size || size > args->size - offset)
+		return -ERANGE;
 
-	for (shndx = 0; shndx < elf->ehdr->e_shnum; shndx++) {
-		section = elf_section_header(elf, shndx);
+	/* Patches are kept disjoint, absorb all touching the new one */
+	do {
+		merged = 0;
 
-		if (strcmp(name, elf_section_name(elf, section->sh_name)))
-			continue;
+		for (patch = args->patches; patch; patch = patch->next) {
+			if (patch->offset > end || patch->offset + patch->size < start)
+				continue;
+
+			if (patch->offset < start || patch->offset + patch->size > end) {
+				start = patch->offset < start ? patch->offset : start;
+				end = patch->offset + patch->size > end ? patch->offset + patch->size : end;
+				merged = 1;
+			}
+		}
+	} while (merged);
 
-		if (num)
-			*num = section->sh_size / section->sh_entsize;
+	/* Remember the original bytes for incremental checksums */
+	patch = malloc(sizeof(*patch));
+	if (!patch)
+		return -ENOMEM;
 
-		return elf_section(elf, shndx);
+	patch->old = malloc(end - start);
+	if (!patch->old) {
+		free(patch);
+		return -ENOMEM;
 	}
 
-	return NULL;
-}
+	memcpy(patch->old, elf_offset(args, start), end - start);
+	patch->offset = start;
+	patch->size = end - start;
 
-static int parse_elf32_file(struct elfconf_arguments *args, struct elfconf_elf32file *elf) {
-	/* Initialize pointers to section headers */
-	elf->ehdr = elf_offset(args, 0);
-	elf->shdr = elf_offset(args, elf->ehdr->e_shoff);
+	for (pos = &args->patches; (prev = *pos); ) {
+		if (prev->offset < start || prev->offset + prev->size > end) {
+			pos = &prev->next;
+			continue;
+		}
 
-	/* Assign .shstrtab section first */
-	elf->shstrtab = elf_section(elf, elf->ehdr->e_shstrndx);
+		memcpy(patch->old + prev->offset - start, prev->old, prev->size);
+		*pos = prev->next;
+		free(prev->old);
+		free(prev);
+	}
 
-	/* Search for .symtab and .strtab section */
-	elf->symtab = find_elf32_section(elf, ELFCONF_SECTION_SYMTAB, &elf->numsyms);
-	if (!elf->symtab)
-		return -ENAVAIL;
+	patch->next = args->patches;
+	args->patches = patch;
 
-	elf->strtab = find_elf32_section(elf, ELFCONF_SECTION_STRTAB, NULL);
-	if (!elf->strtab)
-		return -ENAVAIL;
+	/* Keep the mapping and the file in sync */
+	memcpy(elf_offset(args, offset), data, size);
+
+	fseek(args->efp, offset, SEEK_SET);
+	if (fwrite(data, 1, size, args->efp) != size)
+		return -EBADFD;
 
 	return 0;
 }
 
-static Elf32_Sym *find_elf32_symbol(struct elfconf_elf32file *elf, char *name) {
-	Elf32_Sym *symbol;
-	unsigned int index;
+/*
+ * Read the value of a symbol or member in the byte order of the ELF.
+ */
+static int read_elfconf_object(struct elfconf_arguments *args, struct elfconf_object *obj,
+		unsigned long *val) {
+	unsigned char *ident = args->buf, *data = obj->data;
+	unsigned long raw = 0, mask, size = obj->size;
+	unsigned int i, shift;
 
-	for(index = 0; index < elf->numsyms; index++) {
-		symbol = elf_symbol(elf, index);
-		if (strcmp(name, elf_symbol_name(elf, symbol)))
-			continue;
+	if (!data)
+		return -ENAVAIL;
 
-		if (symbol->st_shndx == SHN_UNDEF)
-			return NULL;
+	if (obj->bit_size && obj->size > sizeof(raw))
+		return -ENOTSUP;
 
-		print_elf32_symbol_info(elf, symbol);
+	/* Only the low-order bytes of larger objects fit */
+	if (size > sizeof(raw)) {
+		size = sizeof(raw);
+		if (ident[EI_DATA] == ELFDATA2MSB)
+			data += obj->size - size;
+	}
 
-		return symbol;
+	for (i = 0; i < size; i++) {
+		if (ident[EI_DATA] == ELFDATA2MSB)
+			raw = raw << 8 | data[i];
+		else
+			raw |= (unsigned long)data[i] << (i * 8);
 	}
 
-	return NULL;
-}
+	if (!obj->bit_size) {
+		*val = raw;
+		return 0;
+	}
 
-static int configure_elf32_symbol(struct elfconf_arguments *args, struct elfconf_elf32file *elf) {
-	Elf32_Sym *symbol;
-	size_t offset, write;
+	shift = ident[EI_DATA] == ELFDATA2MSB ? obj->size * 8 - obj->bit_offset - obj->bit_size : obj->bit_offset;
+	mask = obj->bit_size < sizeof(mask) * 8 ? (1UL << obj->bit_size) - 1 : ~0UL;
+	*val = (raw >> shift) & mask;
 
-	symbol = find_elf32_symbol(elf, args->sym);
-	if (!symbol)
-		return -ENAVAIL;
+	return 0;
+}
 
-	/* Move pointer to the symbol in the ELF file */
-	offset = elf_symbol_offset(elf, symbol);
-	fseek(args->efp, offset, SEEK_SET);
+static int write_elfconf_object(struct elfconf_arguments *args, struct elfconf_object *obj,
+		unsigned long val) {
+	unsigned char *ident = args->buf, *data = obj->data, bytes[sizeof(val)];
+	unsigned long raw = 0, mask;
+	unsigned int i, shift;
 
-	/* Write new value at the specified symbol */
-	write = fwrite(&args->val, 1, symbol->st_size, args->efp);
-	if (write != symbol->st_size)
-		return -EBADFD;
+	if (!data)
+		return -ENAVAIL;
 
-	return 0;
-}
+	if (obj->size > sizeof(raw))
+		return obj->bit_size ? -ENOTSUP : -ERANGE;
 
-static int apply_elf32_args(struct elfconf_arguments *args) {
-	struct elfconf_elf32file elf;
+	if (obj->bit_size) {
+		/* Read-modify-write of the bytes containing the bitfield */
+		for (i = 0; i < obj->size; i++) {
+			if (ident[EI_DATA] == ELFDATA2MSB)
+				raw = raw << 8 | data[i];
+			else
+				raw |= (unsigned long)data[i] << (i * 8);
+		}
 
-	/* Fill up data structure */
-	if (parse_elf32_file(args, &elf))
-		return -EFAULT;
+		shift = ident[EI_DATA] == ELFDATA2MSB ? obj->size * 8 - obj->bit_offset - obj->bit_size : obj->bit_offset;
+		mask = obj->bit_size < sizeof(mask) * 8 ? (1UL << obj->bit_size) - 1 : ~0UL;
+		raw = (raw & ~(mask << shift)) | ((val & mask) << shift);
+	} else {
+		raw = val;
+	}
 
-	/* Search and modify symbol */
-	if (configure_elf32_symbol(args, &elf))
-		return -EFAULT;
+	for (i = 0; i < obj->size; i++) {
+		if (ident[EI_DATA] == ELFDATA2MSB)
+			bytes[i] = raw >> ((obj->size - 1 - i) * 8);
+		else
+			bytes[i] = raw >> (i * 8);
+	}
 
-	return 0;
+	return write_elfconf_file(args, obj->offset, bytes, obj->size);
 }
 
 /*
- * 64-bit ELF functions
+ * Checksums
+ *
+ * Checksums are recomputed after all symbols have been written. The
+ * range of each checksum is split into blocks of ELFCONF_CHECKSUM_BLOCK
+ * bytes and the per-block state is stored in a cache next to the ELF,
+ * so that subsequent runs do not start over:
+ *
+ * - CRC32 is linear, so the new CRC is the old CRC combined with the
+ *   CRC of the modified bytes, shifted to the end of the range.
+ * - SHA-256 is resumed from the midstate of the first modified block,
+ *   so everything after it is hashed again.
+ * - The build-id is a hash tree: the SHA-256 of the digests of all
+ *   blocks. Only modified blocks are hashed again.
+ *
+ * The cache is only trusted if the ELF has not been touched since the
+ * cache was written and the digest stored in the ELF matches.
  */
 
-static void *find_elf64_section(struct elfconf_elf64file *elf, char *name, unsigned int *num) {
-	Elf64_Shdr *section;
-	unsigned int shndx;
+struct elfconf_sha256 {
+	uint32_t state[8];
+	uint64_t count;
+	unsigned char buf[64];
+};
 
-	for (shndx = 0; shndx < elf->ehdr->e_shnum; shndx++) {
-		section = elf_section_header(elf, shndx);
+static const uint32_t sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
 
-		if (strcmp(name, elf_section_name(elf, section->sh_name)))
-			continue;
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
 
-		if (num)
-			*num = section->sh_size / section->sh_entsize;
+#define ror32(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
 
-		return elf_section(elf, shndx);
-	}
+static void sha256_block(uint32_t *state, const unsigned char *data) {
+	uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+	unsigned int i;
 
-	return NULL;
-}
+	for (i = 0; i < 16; i++)
+		w[i] = (uint32_t)data[i * 4] << 24 | (uint32_t)data[i * 4 + 1] << 16 |
+			   (uint32_t)data[i * 4 + 2] << 8 | data[i * 4 + 3];
 
-static int parse_elf64_file(struct elfconf_arguments *args, struct elfconf_elf64file *elf) {
-	/* Initialize pointers to section headers */
-	elf->ehdr = elf_offset(args, 0);
-	elf->shdr = elf_offset(args, elf->ehdr->e_shoff);
+	for (i = 16; i < 64; i++)
+		w[i] = w[i - 16] + w[i - 7] +
+			   (ror32(w[i - 15], 7) ^ ror32(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+			   (ror32(w[i - 2], 17) ^ ror32(w[i - 2], 19) ^ (w[i - 2] >> 10));
 
-	/* Assign .shstrtab section first */
-	elf->shstrtab = elf_section(elf, elf->ehdr->e_shstrndx);
+	a = state[0]; b = state[1]; c = state[2]; d = state[3];
+	e = state[4]; f = state[5]; g = state[6]; h = state[7];
 
-	/* Search for .symtab and .strtab section */
-	elf->symtab = find_elf64_section(elf, ELFCONF_SECTION_SYMTAB, &elf->numsyms);
-	if (!elf->symtab)
-		return -ENAVAIL;
+	for (i = 0; i < 64; i++) {
+		t1 = h + (ror32(e, 6) ^ ror32(e, 11) ^ ror32(e, 25)) +
+			 ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+		t2 = (ror32(a, 2) ^ ror32(a, 13) ^ ror32(a, 22)) +
+			 ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
 
-	elf->strtab = find_elf64_section(elf, ELFCONF_SECTION_STRTAB, NULL);
-	if (!elf->strtab)
-		return -ENAVAIL;
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
 
-	return 0;
+static void sha256_init(struct elfconf_sha256 *ctx, const uint32_t *state, uint64_t count) {
+	memcpy(ctx->state, state, sizeof(ctx->state));
+	ctx->count = count;
 }
 
-static Elf64_Sym *find_elf64_symbol(struct elfconf_elf64file *elf, char *name) {
-	Elf64_Sym *symbol;
-	unsigned int index;
+static void sha256_update(struct elfconf_sha256 *ctx, const unsigned char *data, size_t len) {
+	size_t used = ctx->count % 64, fill;
 
-	for(index = 0; index < elf->numsyms; index++) {
-		symbol = elf_symbol(elf, index);
-		if (strcmp(name, elf_symbol_name(elf, symbol)))
-			continue;
+	ctx->count += len;
 
-		if (symbol->st_shndx == SHN_UNDEF)
-			return NULL;
+	if (used) {
+		fill = 64 - used < len ? 64 - used : len;
+		memcpy(ctx->buf + used, data, fill);
+		data += fill;
+		len -= fill;
 
-		print_elf64_symbol_info(elf, symbol);
+		if (used + fill < 64)
+			return;
 
-		return symbol;
+		sha256_block(ctx->state, ctx->buf);
 	}
 
-	return NULL;
+	for (; len >= 64; data += 64, len -= 64)
+		sha256_block(ctx->state, data);
+
+	memcpy(ctx->buf, data, len);
 }
 
-static int configure_elf64_symbol(struct elfconf_arguments *args, struct elfconf_elf64file *elf) {
-	Elf64_Sym *symbol;
-	size_t offset, write;
+static void sha256_final(struct elfconf_sha256 *ctx, unsigned char *digest) {
+	static const unsigned char pad[64] = { 0x80 };
+	unsigned char bits[8];
+	uint64_t count = ctx->count * 8;
+	unsigned int i;
 
-	symbol = find_elf64_symbol(elf, args->sym);
-	if (!symbol)
-		return -ENAVAIL;
+	for (i = 0; i < 8; i++)
+		bits[i] = count >> (56 - i * 8);
 
-	/* Move pointer to the symbol in the ELF file */
-	offset = elf_symbol_offset(elf, symbol);
-	fseek(args->efp, offset, SEEK_SET);
+	sha256_update(ctx, pad, 1 + (119 - ctx->count % 64) % 64);
+	sha256_update(ctx, bits, sizeof(bits));
 
-	/* Write new value at the specified symbol */
-	write = fwrite(&args->val, 1, symbol->st_size, args->efp);
-	if (write != symbol->st_size)
-		return -EBADFD;
+	for (i = 0; i < 32; i++)
+		digest[i] = ctx->state[i / 4] >> (24 - (i % 4) * 8);
+}
 
-	return 0;
+static uint32_t crc32_table[256];
+
+static uint32_t crc32_raw(uint32_t crc, const unsigned char *data, size_t len) {
+	uint32_t c;
+	unsigned int i, j;
+
+	if (!crc32_table[1]) {
+		for (i = 0; i < 256; i++) {
+			for (c = i, j = 0; j < 8; j++)
+				c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			crc32_table[i] = c;
+		}
+	}
+
+	while (len--)
+		crc = crc32_table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+
+	return crc;
 }
 
-static int apply_elf64_args(struct elfconf_arguments *args) {
-	struct elfconf_elf64file elf;
+static uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec) {
+	uint32_t sum = 0;
 
-	/* Fill up data structure */
-	if (parse_elf64_file(args, &elf))
-		return -EFAULT;
+	for (; vec; vec >>= 1, mat++)
+		if (vec & 1)
+			sum ^= *mat;
 
-	/* Search and modify symbol */
-	if (configure_elf64_symbol(args, &elf))
-		return -EFAULT;
+	return sum;
+}
 
-	return 0;
+static void gf2_matrix_square(uint32_t *square, const uint32_t *mat) {
+	unsigned int n;
+
+	for (n = 0; n < 32; n++)
+		square[n] = gf2_matrix_times(mat, mat[n]);
 }
 
-static int parse_elfconf_file(struct elfconf_arguments *args) {
-	struct elfconf_ehdr *ehdr = args->buf;
+/* Feed len zero bytes into a raw CRC register in O(log len) */
+static uint32_t crc32_shift(uint32_t crc, size_t len) {
+	uint32_t even[32], odd[32], row = 1;
+	unsigned int n;
 
-	/* Validate ELF signature at beginning of file */
-	if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG))
-		return -ENOTSUP;
+	odd[0] = 0xedb88320;
+	for (n = 1; n < 32; n++, row <<= 1)
+		odd[n] = row;
 
-	print_elfconf_ehdr(args->elf, ehdr);
+	gf2_matrix_square(even, odd);
+	gf2_matrix_square(odd, even);
 
-	/*
-	 * Determine ELF class: 32-bit or 64-bit
-	 */
+	while (len) {
+		gf2_matrix_square(even, odd);
+		if (len & 1)
+			crc = gf2_matrix_times(even, crc);
+		len >>= 1;
 
-	if (ehdr->e_ident[EI_CLASS] == ELFCLASS32)
-		return apply_elf32_args(args);
+		if (!len)
+			break;
 
-	if (ehdr->e_ident[EI_CLASS] == ELFCLASS64)
-		return apply_elf64_args(args);
+		gf2_matrix_square(odd, even);
+		if (len & 1)
+			crc = gf2_matrix_times(odd, crc);
+		len >>= 1;
+	}
 
-	return -ENOTSUP;
+	return crc;
 }
 
-static int apply_elfconf_args(struct elfconf_arguments *args) {
-	size_t size, read;
+static const unsigned char checksum_zeroes[4096];
 
-	/* Open ELF file */
-	args->efp = fopen(args->elf, "rb+");
-	if (!args->efp)
-		return -EBADFD;
+/*
+ * Feed the bytes [start, end) of the ELF buffer to a checksum, with
+ * the digest bytes of the checksum replaced by zeroes.
+ */
+static void checksum_feed(struct elfconf_arguments *args, struct elfconf_checksum *csum,
+		size_t start, size_t end, void *ctx) {
+	const unsigned char *data;
+	size_t next, len;
+
+	while (start < end) {
+		if (start >= csum->hoff && start < csum->hoff + csum->hsize) {
+			next = csum->hoff + csum->hsize < end ? csum->hoff + csum->hsize : end;
+			len = next - start < sizeof(checksum_zeroes) ? next - start : sizeof(checksum_zeroes);
+			data = checksum_zeroes;
+		} else {
+			next = csum->hoff > start && csum->hoff < end ? csum->hoff : end;
+			len = next - start;
+			data = elf_offset(args, start);
+		}
 
-	/* Get ELF size */
-	fseek(args->efp, 0L, SEEK_END);
-	size = ftell(args->efp);
+		if (csum->type == ELFCONF_CHECKSUM_CRC32)
+			*(uint32_t *)ctx = crc32_raw(*(uint32_t *)ctx, data, len);
+		else
+			sha256_update(ctx, data, len);
 
-	/* Alloc buffer and read ELF */
-	args->buf = malloc(size);
-	if (!args->buf) {
-		clear_elfconf_file(args);
-		return -ENOMEM;
+		start += len;
 	}
+}
 
-	fseek(args->efp, 0L, SEEK_SET);
-	read = fread(args->buf, 1, size, args->efp);
-	if (read != size) {
-		clear_elfconf_file(args);
-		return -EBADFD;
+static void store_checksum_crc32(struct elfconf_arguments *args, struct elfconf_checksum *csum,
+		uint32_t crc) {
+	unsigned char *ident = args->buf;
+	unsigned int i;
+
+	/* Store the CRC in the byte order of the ELF */
+	for (i = 0; i < 4; i++) {
+		if (ident[EI_DATA] == ELFDATA2MSB)
+			csum->digest[i] = crc >> (24 - i * 8);
+		else
+			csum->digest[i] = crc >> (i * 8);
 	}
+}
 
-	if (parse_elfconf_file(args)) {
-		clear_elfconf_file(args);
-		return -EFAULT;
+static uint32_t load_checksum_crc32(struct elfconf_arguments *args, struct elfconf_checksum *csum) {
+	unsigned char *ident = args->buf;
+	uint32_t crc = 0;
+	unsigned int i;
+
+	for (i = 0; i < 4; i++) {
+		if (ident[EI_DATA] == ELFDATA2MSB)
+			crc |= (uint32_t)csum->digest[i] << (24 - i * 8);
+		else
+			crc |= (uint32_t)csum->digest[i] << (i * 8);
 	}
 
-	return 0;
+	return crc;
 }
 
-/*
- * Parsing arguments
- */
+/* Digest of one block of the build-id, stored in place of its midstate */
+static void hash_checksum_block(struct elfconf_arguments *args, struct elfconf_checksum *csum,
+		size_t block) {
+	struct elfconf_sha256 ctx;
+	size_t start, end;
 
-static int parse_elfconf_args(int argc, char *argv[], struct elfconf_arguments *args)
-{
-	int option;
+	start = csum->offset + block * ELFCONF_CHECKSUM_BLOCK;
+	end = start + ELFCONF_CHECKSUM_BLOCK;
+	if (end > csum->offset + csum->size)
+		end = csum->offset + csum->size;
 
-	/*
-	 * Options supported by elfconf:
-	 *
-	 * -h: Show usage of this program and quit.
-	 *
-	 * The following options need to be specified together:
-	 *
-	 * -f: ELF input file to be manipulated.
-	 * -s: Symbol name in ELF which we want to modify.
-	 * -v: The value that should be written to the symbol.
-	 */
+	sha256_init(&ctx, sha256_iv, 0);
+	checksum_feed(args, csum, start, end, &ctx);
+	sha256_final(&ctx, (unsigned char *)(csum->states + block * 8));
+}
 
-	while ((option = getopt(argc, argv, "hf:s:v:")) != -1) {
-		switch (option) {
-			case 'h':
-				print_elfconf_info(argv[0]);
+static void hash_checksum_tree(struct elfconf_checksum *csum) {
+	struct elfconf_sha256 ctx;
+
+	sha256_init(&ctx, sha256_iv, 0);
+	sha256_update(&ctx, (unsigned char *)csum->states, csum->numstates * 8 * sizeof(uint32_t));
+	sha256_final(&ctx, csum->digest);
+}
+
+static int compute_checksum_full(struct elfconf_arguments *args, struct elfconf_checksum *csum) {
+	struct elfconf_sha256 ctx;
+	size_t block, start, end;
+	uint32_t crc = 0xffffffff;
+
+	if (csum->type == ELFCONF_CHECKSUM_CRC32) {
+		checksum_feed(args, csum, csum->offset, csum->offset + csum->size, &crc);
+		store_checksum_crc32(args, csum, ~crc);
+		return 0;
+	}
+
+	free(csum->states);
+	csum->numstates = (csum->size + ELFCONF_CHECKSUM_BLOCK - 1) / ELFCONF_CHECKSUM_BLOCK;
+	csum->states = malloc((csum->numstates + 1) * sizeof(ctx.state));
+	if (!csum->states)
+		return -ENOMEM;
+
+	if (csum->type == ELFCONF_CHECKSUM_BUILDID) {
+		for (block = 0; block < csum->numstates; block++)
+			hash_checksum_block(args, csum, block);
+
+		hash_checksum_tree(csum);
+
+		return 0;
+	}
+
+	sha256_init(&ctx, sha256_iv, 0);
+
+	for (block = 0; block < csum->numstates; block++) {
+		memcpy(csum->states + block * 8, ctx.state, sizeof(ctx.state));
+
+		start = csum->offset + block * ELFCONF_CHECKSUM_BLOCK;
+		end = start + ELFCONF_CHECKSUM_BLOCK;
+		if (end > csum->offset + csum->size)
+			end = csum->offset + csum->size;
+
+		checksum_feed(args, csum, start, end, &ctx);
+	}
+
+	sha256_final(&ctx, csum->digest);
+
+	return 0;
+}
+
+static int compute_checksum_incremental(struct elfconf_arguments *args,
+		struct elfconf_checksum *csum) {
+	struct elfconf_patch *patch;
+	struct elfconf_sha256 ctx;
+	unsigned char *delta;
+	size_t start, end, first = csum->size, block, i;
+	uint32_t crc, diff;
+
+	crc = load_checksum_crc32(args, csum);
+
+	for (patch = args->patches; patch; patch = patch->next) {
+		start = patch->offset > csum->offset ? patch->offset : csum->offset;
+		end = patch->offset + patch->size;
+		if (end > csum->offset + csum->size)
+			end = csum->offset + csum->size;
+
+		if (start >= end)
+			continue;
+
+		/* Changes to the digest itself are hashed as zeroes */
+		if (start >= csum->hoff && end <= csum->hoff + csum->hsize)
+			continue;
+
+		if (csum->type == ELFCONF_CHECKSUM_BUILDID) {
+			for (block = (start - csum->offset) / ELFCONF_CHECKSUM_BLOCK;
+				 block <= (end - 1 - csum->offset) / ELFCONF_CHECKSUM_BLOCK; block++)
+				hash_checksum_block(args, csum, block);
+
+			first = 0;
+			continue;
+		}
+
+		if (csum->type != ELFCONF_CHECKSUM_CRC32) {
+			if (start - csum->offset < first)
+				first = start - csum->offset;
+			continue;
+		}
+
+		/*
+		 * The CRCs of two messages of the same length differ by the
+		 * raw CRC of their XOR, which is zero outside of the patch.
+		 */
+		delta = malloc(end - start);
+		if (!delta)
+			return -ENOMEM;
+
+		for (i = start; i < end; i++) {
+			if (i >= csum->hoff && i < csum->hoff + csum->hsize)
+				delta[i - start] = 0;
+			else
+				delta[i - start] = patch->old[i - patch->offset] ^
+								   *(unsigned char *)elf_offset(args, i);
+		}
+
+		diff = crc32_raw(0, delta, end - start);
+		crc ^= crc32_shift(diff, csum->offset + csum->size - end);
+		free(delta);
+	}
+
+	if (csum->type == ELFCONF_CHECKSUM_CRC32) {
+		store_checksum_crc32(args, csum, crc);
+		return 0;
+	}
+
+	if (first == csum->size)
+		return 0;
+
+	if (csum->type == ELFCONF_CHECKSUM_BUILDID) {
+		hash_checksum_tree(csum);
+		return 0;
+	}
+
+	/* Resume hashing at the first modified block */
+	block = first / ELFCONF_CHECKSUM_BLOCK;
+	sha256_init(&ctx, csum->states + block * 8, (uint64_t)block * ELFCONF_CHECKSUM_BLOCK);
+
+	for (; block < csum->numstates; block++) {
+		memcpy(csum->states + block * 8, ctx.state, sizeof(ctx.state));
+
+		start = csum->offset + block * ELFCONF_CHECKSUM_BLOCK;
+		end = start + ELFCONF_CHECKSUM_BLOCK;
+		if (end > csum->offset + csum->size)
+			end = csum->offset + csum->size;
+
+		checksum_feed(args, csum, start, end, &ctx);
+	}
+
+	sha256_final(&ctx, csum->digest);
+
+	return 0;
+}
+
+static char *elfconf_cache_name(struct elfconf_arguments *args) {
+	char *name = malloc(strlen(args->elf) + sizeof(ELFCONF_CACHE_SUFFIX));
+
+	if (name)
+		sprintf(name, "%s%s", args->elf, ELFCONF_CACHE_SUFFIX);
+
+	return name;
+}
+
+struct elfconf_cache_header {
+	char magic[8];
+	uint64_t size;
+	int64_t mtime;
+	int64_t mtime_nsec;
+	uint32_t numcsums;
+};
+
+struct elfconf_cache_entry {
+	uint32_t type;
+	uint32_t block;
+	uint64_t offset;
+	uint64_t size;
+	uint64_t hoff;
+	uint64_t hsize;
+	uint64_t numstates;
+	unsigned char digest[32];
+};
+
+/*
+ * Load the cached state of all checksums. Returns a bitmask of the
+ * checksums for which the cache is valid.
+ */
+static unsigned long load_elfconf_cache(struct elfconf_arguments *args) {
+	struct elfconf_cache_header header;
+	struct elfconf_cache_entry entry;
+	struct elfconf_checksum *csum;
+	unsigned long valid = 0, bit;
+	unsigned int index;
+	char *name;
+	FILE *cfp;
+
+	name = elfconf_cache_name(args);
+	if (!name)
+		return 0;
+
+	cfp = fopen(name, "rb");
+	free(name);
+	if (!cfp)
+		return 0;
+
+	if (fread(&header, sizeof(header), 1, cfp) != 1)
+		goto out;
+
+	/* The ELF must not have been modified since */
+	if (memcmp(header.magic, ELFCONF_CACHE_MAGIC, sizeof(header.magic)) ||
+		header.size != (uint64_t)args->est.st_size ||
+		header.mtime != args->est.st_mtim.tv_sec ||
+		header.mtime_nsec != args->est.st_mtim.tv_nsec)
+		goto out;
+
+	for (index = 0; index < header.numcsums; index++) {
+		if (fread(&entry, sizeof(entry), 1, cfp) != 1)
+			goto out;
+
+		for (csum = args->csums, bit = 1; csum; csum = csum->next, bit <<= 1) {
+			if ((valid & bit) || entry.type != (uint32_t)csum->type ||
+				entry.block != ELFCONF_CHECKSUM_BLOCK ||
+				entry.offset != csum->offset || entry.size != csum->size ||
+				entry.hoff != csum->hoff || entry.hsize != csum->hsize)
+				continue;
+
+			break;
+		}
+
+		if (!csum || entry.numstates > SIZE_MAX / sizeof(csum->states[0]) / 8) {
+			fseek(cfp, entry.numstates * 8 * sizeof(uint32_t), SEEK_CUR);
+			continue;
+		}
+
+		csum->numstates = entry.numstates;
+		csum->states = malloc((csum->numstates + 1) * 8 * sizeof(uint32_t));
+		if (!csum->states)
+			goto out;
+
+		if (fread(csum->states, 8 * sizeof(uint32_t), csum->numstates, cfp) != csum->numstates)
+			goto out;
+
+		/* The digest in the ELF has to match the cached one */
+		if (memcmp(entry.digest, elf_offset(args, csum->hoff), csum->hsize))
+			continue;
+
+		memcpy(csum->digest, entry.digest, sizeof(csum->digest));
+		valid |= bit;
+	}
+
+out:
+	fclose(cfp);
+
+	return valid;
+}
+
+static int save_elfconf_cache(struct elfconf_arguments *args) {
+	struct elfconf_cache_header header = { ELFCONF_CACHE_MAGIC };
+	struct elfconf_cache_entry entry = { 0 };
+	struct elfconf_checksum *csum;
+	struct stat est;
+	char *name;
+	FILE *cfp;
+	int ret = 0;
+
+	if (!args->csums)
+		return 0;
+
+	if (stat(args->elf, &est))
+		return -EBADFD;
+
+	header.size = est.st_size;
+	header.mtime = est.st_mtim.tv_sec;
+	header.mtime_nsec = est.st_mtim.tv_nsec;
+
+	for (csum = args->csums; csum; csum = csum->next)
+		header.numcsums++;
+
+	name = elfconf_cache_name(args);
+	if (!name)
+		return -ENOMEM;
+
+	cfp = fopen(name, "wb");
+	free(name);
+	if (!cfp)
+		return -EBADFD;
+
+	if (fwrite(&header, sizeof(header), 1, cfp) != 1)
+		ret = -EBADFD;
+
+	for (csum = args->csums; csum && !ret; csum = csum->next) {
+		entry.type = csum->type;
+		entry.block = ELFCONF_CHECKSUM_BLOCK;
+		entry.offset = csum->offset;
+		entry.size = csum->size;
+		entry.hoff = csum->hoff;
+		entry.hsize = csum->hsize;
+		entry.numstates = csum->numstates;
+		memcpy(entry.digest, csum->digest, sizeof(entry.digest));
+
+		if (fwrite(&entry, sizeof(entry), 1, cfp) != 1 ||
+			fwrite(csum->states, 8 * sizeof(uint32_t), csum->numstates, cfp) != csum->numstates)
+			ret = -EBADFD;
+	}
+
+	fclose(cfp);
+
+	return ret;
+}
+
+/* Checksum that could not be located, see resolve_elf32_checksum() */
+static void report_elfconf_checksum(struct elfconf_arguments *args, struct elfconf_checksum *csum, int err) {
+	const char *reason;
+
+	switch (err) {
+		case -ENOENT:
+			reason = "no such section";
+			break;
+		case -ENAVAIL:
+			if (csum->type == ELFCONF_CHECKSUM_CRC32)
+				reason = "no such symbol";
+			else if (csum->type == ELFCONF_CHECKSUM_SHA256)
+				reason = "no such note section";
+			else
+				reason = "no " ELFCONF_SECTION_BUILDID " section";
+			break;
+		case -ENODATA:
+			reason = "no contents in the file";
+			break;
+		case -ERANGE:
+			reason = "too small for the digest";
+			break;
+		case -EINVAL:
+			reason = "malformed note";
+			break;
+		default:
+			reason = strerror(-err);
+	}
+
+	if (csum->type == ELFCONF_CHECKSUM_BUILDID)
+		fprintf(stderr, "elfconf: cannot update the build-id of %s: %s\n", args->elf, reason);
+	else
+		fprintf(stderr, "elfconf: cannot update the checksum %s:%s:%s of %s: %s\n",
+				csum->type == ELFCONF_CHECKSUM_CRC32 ? "crc32" : "sha256", csum->section,
+				csum->target, args->elf, reason);
+}
+
+static int update_elfconf_checksums(struct elfconf_arguments *args) {
+	struct elfconf_checksum *csum;
+	unsigned long valid, bit;
+	int ret;
+
+	if (!args->csums)
+		return 0;
+
+	valid = load_elfconf_cache(args);
+
+	for (csum = args->csums, bit = 1; csum; csum = csum->next, bit <<= 1) {
+		dprintf("Updating checksum over [%#zx, %#zx) at %#zx (%s)\n",
+				csum->offset, csum->offset + csum->size, csum->hoff,
+				valid & bit ? "incremental" : "full");
+
+		if (valid & bit)
+			ret = compute_checksum_incremental(args, csum);
+		else
+			ret = compute_checksum_full(args, csum);
+
+		if (ret)
+			return ret;
+
+		/* Digests are written as patches, so later checksums see them */
+		ret = write_elfconf_file(args, csum->hoff, csum->digest, csum->hsize);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * DWARF
+ *
+ * Symbols may be followed by the path to a member of their type, like
+ * cfg.net.timeout_ms or table[2].flags. The path is resolved with the
+ * type information in .debug_info:
+ *
+ * - The variable is looked up in .debug_names or .gdb_index, which
+ *   yield its compilation unit without walking all of .debug_info.
+ * - Abbreviation tables are parsed once per unit when first needed.
+ * - Split units are followed to their .dwo file, and stripped ELFs to
+ *   their separate debug file (by build-id or .gnu_debuglink).
+ */
+
+#define ELFCONF_DEBUG_DIR       "/usr/lib/debug"
+#define ELFCONF_DWARF_UNSET     (~0UL)
+
+#define DW_TAG_array_type          0x01
+#define DW_TAG_class_type          0x02
+#define DW_TAG_member              0x0d
+#define DW_TAG_pointer_type        0x0f
+#define DW_TAG_reference_type      0x10
+#define DW_TAG_structure_type      0x13
+#define DW_TAG_typedef             0x16
+#define DW_TAG_union_type          0x17
+#define DW_TAG_subrange_type       0x21
+#define DW_TAG_const_type          0x26
+#define DW_TAG_variable            0x34
+#define DW_TAG_volatile_type       0x35
+#define DW_TAG_restrict_type       0x37
+#define DW_TAG_rvalue_reference_type 0x42
+#define DW_TAG_atomic_type         0x47
+
+#define DW_AT_sibling              0x01
+#define DW_AT_location             0x02
+#define DW_AT_name                 0x03
+#define DW_AT_byte_size            0x0b
+#define DW_AT_bit_offset           0x0c
+#define DW_AT_bit_size             0x0d
+#define DW_AT_comp_dir             0x1b
+#define DW_AT_upper_bound          0x2f
+#define DW_AT_count                0x37
+#define DW_AT_data_member_location 0x38
+#define DW_AT_external             0x3f
+#define DW_AT_specification        0x47
+#define DW_AT_type                 0x49
+#define DW_AT_data_bit_offset      0x6b
+#define DW_AT_str_offsets_base     0x72
+#define DW_AT_dwo_name             0x76
+#define DW_AT_GNU_dwo_name         0x2130
+
+#define DW_FORM_addr               0x01
+#define DW_FORM_block2             0x03
+#define DW_FORM_block4             0x04
+#define DW_FORM_data2              0x05
+#define DW_FORM_data4              0x06
+#define DW_FORM_data8              0x07
+#define DW_FORM_string             0x08
+#define DW_FORM_block              0x09
+#define DW_FORM_block1             0x0a
+#define DW_FORM_data1              0x0b
+#define DW_FORM_flag               0x0c
+#define DW_FORM_sdata              0x0d
+#define DW_FORM_strp               0x0e
+#define DW_FORM_udata              0x0f
+#define DW_FORM_ref_addr           0x10
+#define DW_FORM_ref1               0x11
+#define DW_FORM_ref2               0x12
+#define DW_FORM_ref4               0x13
+#define DW_FORM_ref8               0x14
+#define DW_FORM_ref_udata          0x15
+#define DW_FORM_indirect           0x16
+#define DW_FORM_sec_offset         0x17
+#define DW_FORM_exprloc            0x18
+#define DW_FORM_flag_present       0x19
+#define DW_FORM_strx               0x1a
+#define DW_FORM_addrx              0x1b
+#define DW_FORM_ref_sup4           0x1c
+#define DW_FORM_strp_sup           0x1d
+#define DW_FORM_data16             0x1e
+#define DW_FORM_line_strp          0x1f
+#define DW_FORM_ref_sig8           0x20
+#define DW_FORM_implicit_const     0x21
+#define DW_FORM_loclistx           0x22
+#define DW_FORM_rnglistx           0x23
+#define DW_FORM_ref_sup8           0x24
+#define DW_FORM_strx1              0x25
+#define DW_FORM_strx2              0x26
+#define DW_FORM_strx3              0x27
+#define DW_FORM_strx4              0x28
+#define DW_FORM_addrx1             0x29
+#define DW_FORM_addrx2             0x2a
+#define DW_FORM_addrx3             0x2b
+#define DW_FORM_addrx4             0x2c
+#define DW_FORM_GNU_addr_index     0x1f01
+#define DW_FORM_GNU_str_index      0x1f02
+#define DW_FORM_GNU_ref_alt        0x1f20
+#define DW_FORM_GNU_strp_alt       0x1f21
+
+#define DW_UT_type                 0x02
+#define DW_UT_skeleton             0x04
+#define DW_UT_split_compile        0x05
+#define DW_UT_split_type           0x06
+
+#define DW_IDX_compile_unit        0x01
+#define DW_IDX_type_unit           0x02
+#define DW_IDX_die_offset          0x03
+
+#define DW_OP_addr                 0x03
+#define DW_OP_plus_uconst          0x23
+
+/* Attributes of a DIE that are relevant to resolve member paths */
+struct elfconf_dwarf_die {
+	const unsigned char *pos;
+	unsigned long tag;
+	int children;
+	const char *name;
+	const unsigned char *type;
+	const unsigned char *sibling;
+	const unsigned char *specification;
+	unsigned long byte_size;
+	unsigned long bit_size;
+	unsigned long bit_offset;
+	unsigned long data_bit_offset;
+	unsigned long location;
+	/* Static address of variables, from DW_OP_addr */
+	unsigned long addr;
+	int external;
+	unsigned long count;
+	unsigned long upper_bound;
+	unsigned long str_offsets_base;
+	const char *comp_dir;
+	const char *dwo_name;
+};
+
+struct elfconf_dwarf_unit {
+	struct elfconf_debug *debug;
+	const unsigned char *start;
+	const unsigned char *end;
+	const unsigned char *dies;
+	unsigned int version;
+	unsigned int type;
+	unsigned int offset_size;
+	unsigned int addr_size;
+	unsigned long str_offsets_base;
+	struct elfconf_dwarf_abbrevs *abbrevs;
+};
+
+/* Path to a member, resolved by resolve_elfconf_field() */
+struct elfconf_field {
+	unsigned long offset;
+	unsigned long size;
+	unsigned long elem_size;
+	/* Size of the elements of the first dimension, e.g. 16 for char[4][16] */
+	unsigned long row_size;
+	unsigned int bit_offset;
+	unsigned int bit_size;
+};
+
+static inline uint64_t dwarf_read(struct elfconf_debug *debug, const unsigned char **p, unsigned int size) {
+	uint64_t val = 0;
+	unsigned int i;
+
+	for (i = 0; i < size; i++) {
+		if (debug->msb)
+			val = val << 8 | (*p)[i];
+		else
+			val |= (uint64_t)(*p)[i] << (i * 8);
+	}
+
+	*p += size;
+
+	return val;
+}
+
+static inline uint64_t dwarf_uleb(const unsigned char **p) {
+	uint64_t val = 0;
+	unsigned int shift = 0;
+	unsigned char byte;
+
+	do {
+		byte = *(*p)++;
+		if (shift < 64)
+			val |= (uint64_t)(byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	return val;
+}
+
+static inline int64_t dwarf_sleb(const unsigned char **p) {
+	uint64_t val = 0;
+	unsigned int shift = 0;
+	unsigned char byte;
+
+	do {
+		byte = *(*p)++;
+		if (shift < 64)
+			val |= (uint64_t)(byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	if (shift < 64 && (byte & 0x40))
+		val |= -((uint64_t)1 << shift);
+
+	return val;
+}
+
+static struct elfconf_dwarf_abbrevs *get_dwarf_abbrevs(struct elfconf_debug *debug, unsigned long offset) {
+	struct elfconf_dwarf_abbrevs *abbrevs;
+	struct elfconf_dwarf_abbrev *decls;
+	const unsigned char *p, *end;
+	unsigned long code, attr, form;
+	size_t max = 0;
+
+	for (abbrevs = debug->abbrevs; abbrevs; abbrevs = abbrevs->next)
+		if (abbrevs->offset == offset)
+			return abbrevs;
+
+	if (offset >= debug->abbrev.size)
+		return NULL;
+
+	abbrevs = calloc(1, sizeof(*abbrevs));
+	if (!abbrevs)
+		return NULL;
+
+	abbrevs->offset = offset;
+
+	/* Parse the table of this unit only */
+	p = debug->abbrev.data + offset;
+	end = debug->abbrev.data + debug->abbrev.size;
+
+	while (p < end && (code = dwarf_uleb(&p))) {
+		if (abbrevs->count == max) {
+			max = max ? max * 2 : 64;
+			decls = realloc(abbrevs->decls, max * sizeof(*decls));
+			if (!decls) {
+				free(abbrevs->decls);
+				free(abbrevs);
+				return NULL;
+			}
+
+			abbrevs->decls = decls;
+		}
+
+		decls = abbrevs->decls + abbrevs->count++;
+		decls->code = code;
+		decls->tag = dwarf_uleb(&p);
+		decls->children = *p++;
+		decls->specs = p;
+
+		do {
+			attr = dwarf_uleb(&p);
+			form = dwarf_uleb(&p);
+			if (form == DW_FORM_implicit_const)
+				dwarf_sleb(&p);
+		} while ((attr || form) && p < end);
+	}
+
+	abbrevs->next = debug->abbrevs;
+	debug->abbrevs = abbrevs;
+
+	return abbrevs;
+}
+
+static struct elfconf_dwarf_abbrev *find_dwarf_abbrev(struct elfconf_dwarf_abbrevs *abbrevs,
+		unsigned long code) {
+	size_t index;
+
+	/* Codes are usually numbered sequentially */
+	if (code && code <= abbrevs->count && abbrevs->decls[code - 1].code == code)
+		return abbrevs->decls + code - 1;
+
+	for (index = 0; index < abbrevs->count; index++)
+		if (abbrevs->decls[index].code == code)
+			return abbrevs->decls + index;
+
+	return NULL;
+}
+
+static const char *dwarf_string(struct elfconf_dwarf_section *section, uint64_t offset) {
+	if (!section->data || offset >= section->size)
+		return NULL;
+
+	return (const char *)section->data + offset;
+}
+
+static const char *dwarf_strx(struct elfconf_dwarf_unit *unit, uint64_t index) {
+	struct elfconf_debug *debug = unit->debug;
+	const unsigned char *p;
+	uint64_t offset;
+
+	offset = unit->str_offsets_base + index * unit->offset_size;
+	if (offset + unit->offset_size > debug->str_offsets.size)
+		return NULL;
+
+	p = debug->str_offsets.data + offset;
+
+	return dwarf_string(&debug->str, dwarf_read(debug, &p, unit->offset_size));
+}
+
+/*
+ * Read a single attribute value. Constants and section offsets end up
+ * in val, strings in str and references to other DIEs in ref.
+ */
+static int read_dwarf_form(struct elfconf_dwarf_unit *unit, unsigned long form, int64_t implicit,
+		const unsigned char **p, uint64_t *val, const char **str, const unsigned char **ref) {
+	struct elfconf_debug *debug = unit->debug;
+	uint64_t len;
+
+	*val = 0;
+	*str = NULL;
+	*ref = NULL;
+
+	switch (form) {
+		case DW_FORM_addr:
+			*val = dwarf_read(debug, p, unit->addr_size);
+			break;
+		case DW_FORM_flag:
+		case DW_FORM_data1:
+		case DW_FORM_strx1:
+		case DW_FORM_addrx1:
+			*val = dwarf_read(debug, p, 1);
+			break;
+		case DW_FORM_data2:
+		case DW_FORM_strx2:
+		case DW_FORM_addrx2:
+			*val = dwarf_read(debug, p, 2);
+			break;
+		case DW_FORM_strx3:
+		case DW_FORM_addrx3:
+			*val = dwarf_read(debug, p, 3);
+			break;
+		case DW_FORM_data4:
+		case DW_FORM_strx4:
+		case DW_FORM_addrx4:
+		case DW_FORM_ref_sup4:
+			*val = dwarf_read(debug, p, 4);
+			break;
+		case DW_FORM_data8:
+		case DW_FORM_ref_sig8:
+		case DW_FORM_ref_sup8:
+			*val = dwarf_read(debug, p, 8);
+			break;
+		case DW_FORM_data16:
+			*p += 16;
+			break;
+		case DW_FORM_sdata:
+			*val = dwarf_sleb(p);
+			break;
+		case DW_FORM_udata:
+		case DW_FORM_strx:
+		case DW_FORM_addrx:
+		case DW_FORM_loclistx:
+		case DW_FORM_rnglistx:
+		case DW_FORM_GNU_addr_index:
+		case DW_FORM_GNU_str_index:
+			*val = dwarf_uleb(p);
+			break;
+		case DW_FORM_implicit_const:
+			*val = implicit;
+			break;
+		case DW_FORM_flag_present:
+			*val = 1;
+			break;
+		case DW_FORM_string:
+			*str = (const char *)*p;
+			*p += strlen(*str) + 1;
+			break;
+		case DW_FORM_strp:
+		case DW_FORM_line_strp:
+		case DW_FORM_sec_offset:
+		case DW_FORM_strp_sup:
+		case DW_FORM_GNU_strp_alt:
+		case DW_FORM_GNU_ref_alt:
+			*val = dwarf_read(debug, p, unit->offset_size);
+			break;
+		case DW_FORM_ref_addr:
+			/* DWARF 2 used the address size for DW_FORM_ref_addr */
+			*val = dwarf_read(debug, p, unit->version < 3 ? unit->addr_size : unit->offset_size);
+			if (*val < debug->info.size)
+				*ref = debug->info.data + *val;
+			break;
+		case DW_FORM_ref1:
+		case DW_FORM_ref2:
+		case DW_FORM_ref4:
+		case DW_FORM_ref8:
+			*val = dwarf_read(debug, p, 1 << (form - DW_FORM_ref1));
+			if (*val < (uint64_t)(unit->end - unit->start))
+				*ref = unit->start + *val;
+			break;
+		case DW_FORM_ref_udata:
+			*val = dwarf_uleb(p);
+			if (*val < (uint64_t)(unit->end - unit->start))
+				*ref = unit->start + *val;
+			break;
+		case DW_FORM_exprloc:
+		case DW_FORM_block:
+			len = dwarf_uleb(p);
+			*ref = *p;
+			*p += len;
+			break;
+		case DW_FORM_block1:
+			len = dwarf_read(debug, p, 1);
+			*ref = *p;
+			*p += len;
+			break;
+		case DW_FORM_block2:
+			len = dwarf_read(debug, p, 2);
+			*ref = *p;
+			*p += len;
+			break;
+		case DW_FORM_block4:
+			len = dwarf_read(debug, p, 4);
+			*ref = *p;
+			*p += len;
+			break;
+		case DW_FORM_indirect:
+			form = dwarf_uleb(p);
+			return read_dwarf_form(unit, form, implicit, p, val, str, ref);
+		default:
+			return -ENOTSUP;
+	}
+
+	/* Resolve string references */
+	switch (form) {
+		case DW_FORM_strp:
+			*str = dwarf_string(&debug->str, *val);
+			break;
+		case DW_FORM_line_strp:
+			*str = dwarf_string(&debug->line_str, *val);
+			break;
+		case DW_FORM_strx:
+		case DW_FORM_strx1:
+		case DW_FORM_strx2:
+		case DW_FORM_strx3:
+		case DW_FORM_strx4:
+		case DW_FORM_GNU_str_index:
+			*str = dwarf_strx(unit, *val);
+			break;
+	}
+
+	return 0;
+}
+
+/*
+ * Read the DIE at pos and return the position of the next DIE, which
+ * is its first child if it has any.
+ */
+static const unsigned char *read_dwarf_die(struct elfconf_dwarf_unit *unit, const unsigned char *pos,
+		struct elfconf_dwarf_die *die) {
+	struct elfconf_dwarf_abbrev *abbrev;
+	const unsigned char *p = pos, *specs, *ref;
+	unsigned long code, attr, form;
+	int64_t implicit;
+	const char *str;
+	uint64_t val;
+
+	memset(die, 0, sizeof(*die));
+	die->pos = pos;
+	die->byte_size = ELFCONF_DWARF_UNSET;
+	die->bit_size = ELFCONF_DWARF_UNSET;
+	die->bit_offset = ELFCONF_DWARF_UNSET;
+	die->data_bit_offset = ELFCONF_DWARF_UNSET;
+	die->location = ELFCONF_DWARF_UNSET;
+	die->addr = ELFCONF_DWARF_UNSET;
+	die->count = ELFCONF_DWARF_UNSET;
+	die->upper_bound = ELFCONF_DWARF_UNSET;
+	die->str_offsets_base = ELFCONF_DWARF_UNSET;
+
+	if (pos < unit->dies || pos >= unit->end)
+		return NULL;
+
+	/* Null entry, terminating a list of siblings */
+	code = dwarf_uleb(&p);
+	if (!code)
+		return p;
+
+	abbrev = find_dwarf_abbrev(unit->abbrevs, code);
+	if (!abbrev)
+		return NULL;
+
+	die->tag = abbrev->tag;
+	die->children = abbrev->children;
+
+	for (specs = abbrev->specs;;) {
+		attr = dwarf_uleb(&specs);
+		form = dwarf_uleb(&specs);
+		if (!attr && !form)
+			break;
+
+		implicit = form == DW_FORM_implicit_const ? dwarf_sleb(&specs) : 0;
+
+		if (read_dwarf_form(unit, form, implicit, &p, &val, &str, &ref))
+			return NULL;
+
+		switch (attr) {
+			case DW_AT_sibling:
+				die->sibling = ref;
+				break;
+			case DW_AT_name:
+				die->name = str;
+				break;
+			case DW_AT_type:
+				die->type = ref;
+				break;
+			case DW_AT_specification:
+				die->specification = ref;
+				break;
+			case DW_AT_byte_size:
+				die->byte_size = val;
+				break;
+			case DW_AT_bit_size:
+				die->bit_size = val;
+				break;
+			case DW_AT_bit_offset:
+				die->bit_offset = val;
+				break;
+			case DW_AT_data_bit_offset:
+				die->data_bit_offset = val;
+				break;
+			case DW_AT_count:
+				die->count = val;
+				break;
+			case DW_AT_upper_bound:
+				die->upper_bound = val;
+				break;
+			case DW_AT_str_offsets_base:
+				die->str_offsets_base = val;
+				break;
+			case DW_AT_comp_dir:
+				die->comp_dir = str;
+				break;
+			case DW_AT_dwo_name:
+			case DW_AT_GNU_dwo_name:
+				die->dwo_name = str;
+				break;
+			case DW_AT_location:
+				/* Only a plain DW_OP_addr tells the symbol of a variable */
+				if ((form == DW_FORM_exprloc || form == DW_FORM_block1) &&
+					p >= ref + 1 + unit->addr_size && *ref == DW_OP_addr) {
+					ref++;
+					die->addr = dwarf_read(unit->debug, &ref, unit->addr_size);
+				}
+				break;
+			case DW_AT_external:
+				die->external = val;
+				break;
+			case DW_AT_data_member_location:
+				/* Location expressions are DW_OP_plus_uconst in practice */
+				if (form == DW_FORM_exprloc || form == DW_FORM_block || form == DW_FORM_block1 ||
+					form == DW_FORM_block2 || form == DW_FORM_block4) {
+					if (*ref == DW_OP_plus_uconst) {
+						ref++;
+						die->location = dwarf_uleb(&ref);
+					}
+				} else {
+					die->location = val;
+				}
+				break;
+		}
+	}
+
+	return p > unit->end ? NULL : p;
+}
+
+/* Skip the children of a DIE, p pointing to its first child */
+static const unsigned char *skip_dwarf_children(struct elfconf_dwarf_unit *unit, const unsigned char *p) {
+	struct elfconf_dwarf_die die;
+	const unsigned char *next;
+	unsigned int depth = 1;
+
+	while (p && depth) {
+		next = read_dwarf_die(unit, p, &die);
+		if (!next)
+			return NULL;
+
+		if (!die.tag)
+			depth--;
+		else if (die.children && die.sibling)
+			next = die.sibling;
+		else if (die.children)
+			depth++;
+
+		p = next;
+	}
+
+	return p;
+}
+
+static int parse_dwarf_unit(struct elfconf_debug *debug, const unsigned char *start,
+		struct elfconf_dwarf_unit *unit) {
+	const unsigned char *p = start, *end = debug->info.data + debug->info.size;
+	struct elfconf_dwarf_die root;
+	uint64_t length, abbrev;
+
+	if (start < debug->info.data || start + 11 > end)
+		return -ERANGE;
+
+	memset(unit, 0, sizeof(*unit));
+	unit->debug = debug;
+	unit->start = start;
+	unit->offset_size = 4;
+
+	length = dwarf_read(debug, &p, 4);
+	if (length == 0xffffffff) {
+		length = dwarf_read(debug, &p, 8);
+		unit->offset_size = 8;
+	}
+
+	if (length > (uint64_t)(end - p))
+		return -ERANGE;
+
+	unit->end = p + length;
+	unit->version = dwarf_read(debug, &p, 2);
+
+	if (unit->version >= 5) {
+		unit->type = dwarf_read(debug, &p, 1);
+		unit->addr_size = dwarf_read(debug, &p, 1);
+		abbrev = dwarf_read(debug, &p, unit->offset_size);
+
+		if (unit->type == DW_UT_skeleton || unit->type == DW_UT_split_compile)
+			p += 8;
+		else if (unit->type == DW_UT_type || unit->type == DW_UT_split_type)
+			p += 8 + unit->offset_size;
+	} else if (unit->version >= 2) {
+		abbrev = dwarf_read(debug, &p, unit->offset_size);
+		unit->addr_size = dwarf_read(debug, &p, 1);
+	} else {
+		return -ENOTSUP;
+	}
+
+	unit->dies = p;
+	unit->abbrevs = get_dwarf_abbrevs(debug, abbrev);
+	if (!unit->abbrevs)
+		return -EINVAL;
+
+	/* Split units have their string offsets right after the header */
+	if (debug->dwo && unit->version >= 5)
+		unit->str_offsets_base = unit->offset_size == 8 ? 16 : 8;
+
+	if (!read_dwarf_die(unit, unit->dies, &root))
+		return -EINVAL;
+
+	if (root.str_offsets_base != ELFCONF_DWARF_UNSET)
+		unit->str_offsets_base = root.str_offsets_base;
+
+	return 0;
+}
+
+/* Start of the unit containing ref, skipping units by their length alone */
+static const unsigned char *find_dwarf_unit_start(struct elfconf_debug *debug, const unsigned char *ref) {
+	const unsigned char *p = debug->info.data, *end = p + debug->info.size, *start;
+	uint64_t length;
+
+	while (p + 4 <= end) {
+		start = p;
+		length = dwarf_read(debug, &p, 4);
+		if (length == 0xffffffff) {
+			if (p + 8 > end)
+				return NULL;
+
+			length = dwarf_read(debug, &p, 8);
+		}
+
+		if (length > (uint64_t)(end - p))
+			return NULL;
+
+		p += length;
+		if (ref < p)
+			return start;
+	}
+
+	return NULL;
+}
+
+/* Read the DIE a reference points to, which may be in another unit */
+static int read_dwarf_ref(struct elfconf_dwarf_unit *unit, const unsigned char *ref,
+		struct elfconf_dwarf_unit *refunit, struct elfconf_dwarf_die *die) {
+	struct elfconf_debug *debug = unit->debug;
+	const unsigned char *start;
+
+	if (!ref)
+		return -ENAVAIL;
+
+	if (ref >= unit->dies && ref < unit->end) {
+		*refunit = *unit;
+	} else {
+		/* Only the containing unit has its abbreviations parsed */
+		start = find_dwarf_unit_start(debug, ref);
+		if (!start)
+			return -ERANGE;
+
+		if (parse_dwarf_unit(debug, start, refunit))
+			return -EINVAL;
+
+		if (ref < refunit->dies)
+			return -ERANGE;
+	}
+
+	return read_dwarf_die(refunit, ref, die) && die->tag ? 0 : -EINVAL;
+}
+
+/* Follow typedefs and type qualifiers */
+static int strip_dwarf_type(struct elfconf_dwarf_unit *unit, struct elfconf_dwarf_die *die) {
+	unsigned int depth;
+
+	for (depth = 0; depth < 64; depth++) {
+		switch (die->tag) {
+			case DW_TAG_typedef:
+			case DW_TAG_const_type:
+			case DW_TAG_volatile_type:
+			case DW_TAG_restrict_type:
+			case DW_TAG_atomic_type:
+				if (read_dwarf_ref(unit, die->type, unit, die))
+					return -EINVAL;
+				break;
+			default:
+				return 0;
+		}
+	}
+
+	return -ELOOP;
+}
+
+/* Element counts of all dimensions of an array type */
+static int read_dwarf_dims(struct elfconf_dwarf_unit *unit, struct elfconf_dwarf_die *array,
+		unsigned long *dims, unsigned int *numdims) {
+	struct elfconf_dwarf_die die;
+	const unsigned char *p;
+
+	*numdims = 0;
+
+	if (!array->children)
+		return -EINVAL;
+
+	for (p = read_dwarf_die(unit, array->pos, &die); p; ) {
+		p = read_dwarf_die(unit, p, &die);
+		if (!p || !die.tag)
+			break;
+
+		if (die.tag == DW_TAG_subrange_type && *numdims < 8) {
+			if (die.count != ELFCONF_DWARF_UNSET)
+				dims[(*numdims)++] = die.count;
+			else if (die.upper_bound != ELFCONF_DWARF_UNSET)
+				dims[(*numdims)++] = die.upper_bound + 1;
+			else
+				dims[(*numdims)++] = 0;
+		}
+
+		if (die.children)
+			p = die.sibling ? die.sibling : skip_dwarf_children(unit, p);
+	}
+
+	return *numdims ? 0 : -EINVAL;
+}
+
+static int dwarf_type_size(struct elfconf_dwarf_unit *unit, struct elfconf_dwarf_die *type,
+		unsigned long *size) {
+	struct elfconf_dwarf_unit elemunit;
+	struct elfconf_dwarf_die elem;
+	unsigned long dims[8];
+	unsigned int numdims, dim;
+
+	if (strip_dwarf_type(unit, type))
+		return -EINVAL;
+
+	if (type->byte_size != ELFCONF_DWARF_UNSET) {
+		*size = type->byte_size;
+		return 0;
+	}
+
+	switch (type->tag) {
+		case DW_TAG_pointer_type:
+		case DW_TAG_reference_type:
+		case DW_TAG_rvalue_reference_type:
+			*size = unit->addr_size;
+			return 0;
+		case DW_TAG_array_type:
+			if (read_dwarf_dims(unit, type, dims, &numdims))
+				return -EINVAL;
+
+			if (read_dwarf_ref(unit, type->type, &elemunit, &elem) ||
+				dwarf_type_size(&elemunit, &elem, size))
+				return -EINVAL;
+
+			for (dim = 0; dim < numdims; dim++)
+				*size *= dims[dim];
+
+			return 0;
+	}
+
+	return -ENOTSUP;
+}
+
+/*
+ * Find a member by name, including members of anonymous structures and
+ * unions. The offset of the member is added to offset (in bits).
+ */
+static int find_dwarf_member(struct elfconf_dwarf_unit *unit, struct elfconf_dwarf_die *type,
+		const char *name, size_t len, struct elfconf_dwarf_die *member, unsigned long *offset) {
+	struct elfconf_dwarf_unit subunit;
+	struct elfconf_dwarf_die die, sub;
+	const unsigned char *p;
+	unsigned long bits;
+
+	if (!type->children)
+		return -ENAVAIL;
+
+	for (p = read_dwarf_die(unit, type->pos, &die); p; ) {
+		p = read_dwarf_die(unit, p, &die);
+		if (!p || !die.tag)
+			break;
+
+		if (die.children)
+			p = die.sibling ? die.sibling : skip_dwarf_children(unit, p);
+
+		if (die.tag != DW_TAG_member)
+			continue;
+
+		if (die.data_bit_offset != ELFCONF_DWARF_UNSET)
+			bits = die.data_bit_offset;
+		else if (die.location != ELFCONF_DWARF_UNSET)
+			bits = die.location * 8;
+		else
+			bits = 0;
+
+		if (die.name && strlen(die.name) == len && !strncmp(die.name, name, len)) {
+			*member = die;
+			*offset += bits;
+			return 0;
+		}
+
+		if (die.name || read_dwarf_ref(unit, die.type, &subunit, &sub) ||
+			strip_dwarf_type(&subunit, &sub))
+			continue;
+
+		if (sub.tag != DW_TAG_structure_type && sub.tag != DW_TAG_union_type &&
+			sub.tag != DW_TAG_class_type)
+			continue;
+
+		if (!find_dwarf_member(&subunit, &sub, name, len, member, &bits)) {
+			*unit = subunit;
+			*offset += bits;
+			return 0;
+		}
+	}
+
+	return -ENAVAIL;
+}
+
+/* Walk the member path (".a.b[2].c") starting at the given type */
+static int walk_dwarf_path(struct elfconf_dwarf_unit *unit, struct elfconf_dwarf_die *type,
+		const char *path, struct elfconf_field *field) {
+	struct elfconf_dwarf_die member;
+	unsigned long bits = 0, dims[8], index, stride, size;
+	unsigned int numdims = 0, dim = 0, bitfield = 0, i;
+	struct elfconf_dwarf_die elem;
+	struct elfconf_dwarf_unit elemunit;
+	char *end;
+	size_t len;
+
+	while (*path) {
+		/* Bitfields have no members */
+		if (bitfield)
+			return -EINVAL;
+
+		if (*path == '[') {
+			if (!numdims) {
+				if (strip_dwarf_type(unit, type) || type->tag != DW_TAG_array_type)
+					return -EINVAL;
+
+				if (read_dwarf_dims(unit, type, dims, &numdims) ||
+					read_dwarf_ref(unit, type->type, &elemunit, &elem) ||
+					dwarf_type_size(&elemunit, &elem, &size))
+					return -EINVAL;
+
+				dim = 0;
+			}
+
+			index = strtoul(path + 1, &end, 0);
+			if (end == path + 1 || *end != ']')
+				return -EINVAL;
+
+			if (dims[dim] && index >= dims[dim])
+				return -ERANGE;
+
+			for (stride = size, i = dim + 1; i < numdims; i++)
+				stride *= dims[i];
+
+			bits += index * stride * 8;
+			path = end + 1;
+
+			/* All dimensions indexed, continue with the element type */
+			if (++dim == numdims) {
+				numdims = 0;
+				*unit = elemunit;
+				*type = elem;
+			}
+
+			continue;
+		}
+
+		if (*path != '.' || numdims)
+			return -EINVAL;
+
+		path++;
+		len = strcspn(path, ".[");
+
+		if (strip_dwarf_type(unit, type))
+			return -EINVAL;
+
+		if (type->tag != DW_TAG_structure_type && type->tag != DW_TAG_union_type &&
+			type->tag != DW_TAG_class_type)
+			return -EINVAL;
+
+		if (find_dwarf_member(unit, type, path, len, &member, &bits))
+			return -ENAVAIL;
+
+		path += len;
+
+		if (member.bit_size != ELFCONF_DWARF_UNSET) {
+			bitfield = member.bit_size;
+
+			/* DWARF 2/3: bit offset from the MSB of the storage unit */
+			if (member.data_bit_offset == ELFCONF_DWARF_UNSET &&
+				member.bit_offset != ELFCONF_DWARF_UNSET) {
+				size = member.byte_size;
+				if (size == ELFCONF_DWARF_UNSET && (read_dwarf_ref(unit, member.type, &elemunit, &elem) ||
+					dwarf_type_size(&elemunit, &elem, &size)))
+					return -EINVAL;
+
+				if (unit->debug->msb)
+					bits += member.bit_offset;
+				else
+					bits += size * 8 - member.bit_offset - member.bit_size;
+			}
+
+			continue;
+		}
+
+		if (read_dwarf_ref(unit, member.type, unit, type))
+			return -EINVAL;
+	}
+
+	field->offset = bits / 8;
+	field->bit_offset = bitfield ? bits % 8 : 0;
+	field->bit_size = bitfield;
+	field->elem_size = 0;
+	field->row_size = 0;
+
+	if (bitfield) {
+		field->size = (field->bit_offset + bitfield + 7) / 8;
+		return 0;
+	}
+
+	/* Partially indexed arrays span the remaining dimensions */
+	if (numdims) {
+		for (field->size = size, i = dim; i < numdims; i++)
+			field->size *= dims[i];
+
+		field->elem_size = size;
+		field->row_size = dims[dim] ? field->size / dims[dim] : 0;
+
+		return 0;
+	}
+
+	if (dwarf_type_size(unit, type, &field->size))
+		return -EINVAL;
+
+	/* Element size of arrays, for lists and fill patterns */
+	if (type->tag == DW_TAG_array_type && !read_dwarf_ref(unit, type->type, &elemunit, &elem))
+		dwarf_type_size(&elemunit, &elem, &field->elem_size);
+
+	if (type->tag == DW_TAG_array_type && !read_dwarf_dims(unit, type, dims, &numdims) && numdims && dims[0])
+		field->row_size = field->size / dims[0];
+
+	return 0;
+}
+
+/*
+ * Locating debug information
+ */
+
+static int find_elfconf_section(const void *buf, size_t size, const char *name,
+		struct elfconf_dwarf_section *sec) {
+	const unsigned char *ident = buf;
+	const Elf32_Ehdr *ehdr32 = buf;
+	const Elf64_Ehdr *ehdr64 = buf;
+	const Elf32_Shdr *shdr32;
+	const Elf64_Shdr *shdr64;
+	unsigned long offset, length, flags;
+	const char *shstrtab;
+	unsigned int shndx;
+
+	if (size < sizeof(Elf64_Ehdr) || memcmp(ident, ELFMAG, SELFMAG))
+		return -ENOTSUP;
+
+	if (ident[EI_CLASS] == ELFCLASS32) {
+		if (ehdr32->e_shoff + ehdr32->e_shnum * sizeof(*shdr32) > size)
+			return -ERANGE;
+
+		shdr32 = buf + ehdr32->e_shoff;
+		shstrtab = buf + shdr32[ehdr32->e_shstrndx].sh_offset;
+
+		for (shndx = 0; shndx < ehdr32->e_shnum; shndx++)
+			if (!strcmp(name, shstrtab + shdr32[shndx].sh_name))
+				break;
+
+		if (shndx == ehdr32->e_shnum)
+			return -ENAVAIL;
+
+		offset = shdr32[shndx].sh_offset;
+		length = shdr32[shndx].sh_size;
+		flags = shdr32[shndx].sh_flags;
+	} else {
+		if (ehdr64->e_shoff + ehdr64->e_shnum * sizeof(*shdr64) > size)
+			return -ERANGE;
+
+		shdr64 = buf + ehdr64->e_shoff;
+		shstrtab = buf + shdr64[ehdr64->e_shstrndx].sh_offset;
+
+		for (shndx = 0; shndx < ehdr64->e_shnum; shndx++)
+			if (!strcmp(name, shstrtab + shdr64[shndx].sh_name))
+				break;
+
+		if (shndx == ehdr64->e_shnum)
+			return -ENAVAIL;
+
+		offset = shdr64[shndx].sh_offset;
+		length = shdr64[shndx].sh_size;
+		flags = shdr64[shndx].sh_flags;
+	}
+
+	/* Compressed debug sections are not supported */
+	if ((flags & SHF_COMPRESSED) || offset + length > size)
+		return -ENOTSUP;
+
+	sec->data = buf + offset;
+	sec->size = length;
+
+	return 0;
+}
+
+static int init_elfconf_debug(struct elfconf_debug *debug, const void *buf, size_t size) {
+	const unsigned char *ident = buf;
+	const char *suffix = debug->dwo ? ".dwo" : "";
+	char name[32];
+
+	debug->msb = ident[EI_DATA] == ELFDATA2MSB;
+
+	sprintf(name, ".debug_info%s", suffix);
+	if (find_elfconf_section(buf, size, name, &debug->info))
+		return -ENAVAIL;
+
+	sprintf(name, ".debug_abbrev%s", suffix);
+	if (find_elfconf_section(buf, size, name, &debug->abbrev))
+		return -ENAVAIL;
+
+	/* All others are optional */
+	sprintf(name, ".debug_str%s", suffix);
+	find_elfconf_section(buf, size, name, &debug->str);
+	sprintf(name, ".debug_str_offsets%s", suffix);
+	find_elfconf_section(buf, size, name, &debug->str_offsets);
+	find_elfconf_section(buf, size, ".debug_line_str", &debug->line_str);
+	find_elfconf_section(buf, size, ".debug_names", &debug->names);
+	find_elfconf_section(buf, size, ".gdb_index", &debug->gdb_index);
+
+	return 0;
+}
+
+static void free_elfconf_debug(struct elfconf_debug *debug) {
+	struct elfconf_dwarf_abbrevs *abbrevs;
+
+	if (!debug)
+		return;
+
+	free_elfconf_debug(debug->dwos);
+
+	while ((abbrevs = debug->abbrevs)) {
+		debug->abbrevs = abbrevs->next;
+		free(abbrevs->decls);
+		free(abbrevs);
+	}
+
+	if (debug->map)
+		munmap(debug->map, debug->mapsize);
+
+	free(debug->path);
+	free(debug);
+}
+
+static struct elfconf_debug *load_elfconf_debug(const char *path, int dwo) {
+	struct elfconf_debug *debug;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) || !st.st_size) {
+		close(fd);
+		return NULL;
+	}
+
+	/* Debug files can be huge, only the pages that are used are read */
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	debug = calloc(1, sizeof(*debug));
+	if (!debug) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	debug->map = map;
+	debug->mapsize = st.st_size;
+	debug->dwo = dwo;
+	debug->path = strdup(path);
+
+	if (!debug->path || init_elfconf_debug(debug, map, st.st_size)) {
+		free_elfconf_debug(debug);
+		return NULL;
+	}
+
+	dprintf("Using debug information from %s\n", path);
+
+	return debug;
+}
+
+/* Directory of path, including the trailing slash */
+static size_t elfconf_dirname(const char *path) {
+	const char *slash = strrchr(path, '/');
+
+	return slash ? (size_t)(slash - path + 1) : 0;
+}
+
+/* Find the separate debug file through the build-id or .gnu_debuglink */
+static struct elfconf_debug *find_elfconf_debug_file(struct elfconf_arguments *args) {
+	struct elfconf_dwarf_section note, link;
+	struct elfconf_debug *debug = NULL;
+	const unsigned char *ident = args->buf, *id;
+	char path[PATH_MAX], cwd[PATH_MAX];
+	unsigned int i, namesz, descsz;
+	size_t dirlen, len;
+
+	if (!find_elfconf_section(args->buf, args->size, ELFCONF_SECTION_BUILDID, &note) &&
+		note.size > 12) {
+		/* The note header is in the byte order of the ELF */
+		struct elfconf_debug elf = { .msb = ident[EI_DATA] == ELFDATA2MSB };
+
+		id = note.data;
+		namesz = dwarf_read(&elf, &id, 4);
+		descsz = dwarf_read(&elf, &id, 4);
+		id = note.data + 12 + ((namesz + 3) & ~3);
+
+		if (descsz > 1 && namesz < note.size && id + descsz <= note.data + note.size) {
+			len = sprintf(path, "%s/.build-id/%02x/", ELFCONF_DEBUG_DIR, id[0]);
+			for (i = 1; i < descsz && len < sizeof(path) - 8; i++)
+				len += sprintf(path + len, "%02x", id[i]);
+			strcpy(path + len, ".debug");
+
+			debug = load_elfconf_debug(path, 0);
+			if (debug)
+				return debug;
+		}
+	}
+
+	if (find_elfconf_section(args->buf, args->size, ".gnu_debuglink", &link) ||
+		!memchr(link.data, '\0', link.size))
+		return NULL;
+
+	dirlen = elfconf_dirname(args->elf);
+
+	/* Next to the ELF, in .debug/ and in the global debug directory */
+	if (snprintf(path, sizeof(path), "%.*s%s", (int)dirlen, args->elf, link.data) < (int)sizeof(path)) {
+		debug = load_elfconf_debug(path, 0);
+		if (debug)
+			return debug;
+	}
+
+	if (snprintf(path, sizeof(path), "%.*s.debug/%s", (int)dirlen, args->elf, link.data) < (int)sizeof(path)) {
+		debug = load_elfconf_debug(path, 0);
+		if (debug)
+			return debug;
+	}
+
+	if (args->elf[0] == '/')
+		len = snprintf(path, sizeof(path), "%s%.*s%s", ELFCONF_DEBUG_DIR, (int)dirlen, args->elf,
+					   link.data);
+	else if (getcwd(cwd, sizeof(cwd)))
+		len = snprintf(path, sizeof(path), "%s%s/%.*s%s", ELFCONF_DEBUG_DIR, cwd, (int)dirlen,
+					   args->elf, link.data);
+	else
+		return NULL;
+
+	if (len >= sizeof(path))
+		return NULL;
+
+	return load_elfconf_debug(path, 0);
+}
+
+static struct elfconf_debug *get_elfconf_debug(struct elfconf_arguments *args) {
+	if (args->debug || args->nodebug)
+		return args->debug;
+
+	/*
+	 * References in the debug information of relocatable objects are
+	 * only resolved by their .rela.debug_* sections. e_type is at the
+	 * same offset for both classes.
+	 */
+	if (((const Elf32_Ehdr *)args->buf)->e_type == ET_REL) {
+		fprintf(stderr, "elfconf: member paths are not supported in relocatable objects (%s)\n",
+				args->elf);
+		args->nodebug = 1;
+		return NULL;
+	}
+
+	args->debug = calloc(1, sizeof(*args->debug));
+	if (args->debug && !init_elfconf_debug(args->debug, args->buf, args->size))
+		return args->debug;
+
+	free(args->debug);
+
+	/* Stripped ELF, try separate debug file */
+	args->debug = find_elfconf_debug_file(args);
+	args->nodebug = !args->debug;
+
+	return args->debug;
+}
+
+/* Open the .dwo file of a skeleton unit */
+static struct elfconf_debug *get_elfconf_dwo(struct elfconf_arguments *args, struct elfconf_dwarf_unit *unit) {
+	struct elfconf_debug *debug = unit->debug, *dwo;
+	struct elfconf_dwarf_die root;
+	char path[PATH_MAX];
+
+	if (!read_dwarf_die(unit, unit->dies, &root) || !root.dwo_name)
+		return NULL;
+
+	if (root.dwo_name[0] == '/' || !root.comp_dir)
+		snprintf(path, sizeof(path), "%s", root.dwo_name);
+	else
+		snprintf(path, sizeof(path), "%s/%s", root.comp_dir, root.dwo_name);
+
+	for (dwo = debug->dwos; dwo; dwo = dwo->dwos)
+		if (!strcmp(dwo->path, path))
+			return dwo;
+
+	dwo = load_elfconf_debug(path, 1);
+	if (!dwo) {
+		/* Fall back to the directory of the ELF */
+		snprintf(path, sizeof(path), "%.*s%s", (int)elfconf_dirname(args->elf), args->elf,
+				 root.dwo_name);
+		dwo = load_elfconf_debug(path, 1);
+		if (!dwo)
+			return NULL;
+	}
+
+	/* Loaded .dwo files are chained through their dwos member */
+	dwo->dwos = debug->dwos;
+	debug->dwos = dwo;
+
+	return dwo;
+}
+
+/*
+ * Name indexes
+ */
+
+static uint32_t dwarf_names_hash(const char *name) {
+	uint32_t hash = 5381;
+
+	/* DJB hash of the case-folded name */
+	for (; *name; name++)
+		hash = hash * 33 + tolower((unsigned char)*name);
+
+	return hash;
+}
+
+static uint64_t dwarf_names_constant(struct elfconf_debug *debug, unsigned long form,
+		const unsigned char **p) {
+	switch (form) {
+		case DW_FORM_flag_present:
+			return 1;
+		case DW_FORM_flag:
+		case DW_FORM_data1:
+		case DW_FORM_ref1:
+			return dwarf_read(debug, p, 1);
+		case DW_FORM_data2:
+		case DW_FORM_ref2:
+			return dwarf_read(debug, p, 2);
+		case DW_FORM_data4:
+		case DW_FORM_ref4:
+			return dwarf_read(debug, p, 4);
+		case DW_FORM_data8:
+		case DW_FORM_ref8:
+			return dwarf_read(debug, p, 8);
+		default:
+			return dwarf_uleb(p);
+	}
+}
+
+/*
+ * Look up a variable in .debug_names. Returns the offset of its unit
+ * and, if known, the unit-relative offset of its DIE.
+ */
+static int lookup_dwarf_names(struct elfconf_debug *debug, const char *name, unsigned int nth,
+		uint64_t *unitoff, uint64_t *dieoff) {
+	const unsigned char *p = debug->names.data, *end = p + debug->names.size, *next;
+	const unsigned char *cus, *buckets, *hashes, *strs, *entries, *abbrevs, *pool, *q, *a;
+	uint32_t numcus, numltus, numftus, numbuckets, numnames, abbrevsize, augsize;
+	uint32_t hash = dwarf_names_hash(name), index, entryhash;
+	unsigned int osz;
+	uint64_t length, code, tag, idx, form, val, cu, die, strofs;
+	int intu;
+
+	while (p && p + 4 <= end) {
+		osz = 4;
+		length = dwarf_read(debug, &p, 4);
+		if (length == 0xffffffff) {
+			length = dwarf_read(debug, &p, 8);
+			osz = 8;
+		}
+
+		if (length > (uint64_t)(end - p))
+			return -ERANGE;
+
+		next = p + length;
+
+		/* Version and padding */
+		p += 4;
+		numcus = dwarf_read(debug, &p, 4);
+		numltus = dwarf_read(debug, &p, 4);
+		numftus = dwarf_read(debug, &p, 4);
+		numbuckets = dwarf_read(debug, &p, 4);
+		numnames = dwarf_read(debug, &p, 4);
+		abbrevsize = dwarf_read(debug, &p, 4);
+		augsize = dwarf_read(debug, &p, 4);
+		p += augsize;
+
+		cus = p;
+		p += (uint64_t)(numcus + numltus) * osz + (uint64_t)numftus * 8;
+		buckets = p;
+		p += (uint64_t)numbuckets * 4;
+		hashes = p;
+		/* Without buckets, there is no hash table either */
+		if (numbuckets)
+			p += (uint64_t)numnames * 4;
+		strs = p;
+		p += (uint64_t)numnames * osz;
+		entries = p;
+		p += (uint64_t)numnames * osz;
+		abbrevs = p;
+		pool = p + abbrevsize;
+
+		if (pool > next) {
+			p = next;
+			continue;
+		}
+
+		if (numbuckets) {
+			q = buckets + (hash % numbuckets) * 4;
+			index = dwarf_read(debug, &q, 4);
+		} else {
+			index = 1;
+		}
+
+		for (; index && index <= numnames; index++) {
+			if (numbuckets) {
+				q = hashes + (index - 1) * 4;
+				entryhash = dwarf_read(debug, &q, 4);
+
+				if (entryhash % numbuckets != hash % numbuckets)
+					break;
+
+				if (entryhash != hash)
+					continue;
+			}
+
+			q = strs + (index - 1) * osz;
+			strofs = dwarf_read(debug, &q, osz);
+			if (!dwarf_string(&debug->str, strofs) || strcmp(dwarf_string(&debug->str, strofs), name))
+				continue;
+
+			q = entries + (index - 1) * osz;
+			q = pool + dwarf_read(debug, &q, osz);
+
+			/* Walk the entries for this name */
+			while (q < next && (code = dwarf_uleb(&q))) {
+				val = 0;
+				for (a = abbrevs; a < pool; ) {
+					val = dwarf_uleb(&a);
+					if (!val || val == code)
+						break;
+
+					/* Skip tag and attribute list */
+					dwarf_uleb(&a);
+					do {
+						idx = dwarf_uleb(&a);
+						form = dwarf_uleb(&a);
+					} while (idx || form);
+				}
+
+				if (a >= pool || val != code)
+					return -EINVAL;
+
+				tag = dwarf_uleb(&a);
+				cu = 0;
+				die = ELFCONF_DWARF_UNSET;
+				intu = 0;
+
+				for (;;) {
+					idx = dwarf_uleb(&a);
+					form = dwarf_uleb(&a);
+					if (!idx && !form)
+						break;
+
+					val = dwarf_names_constant(debug, form, &q);
+					if (idx == DW_IDX_compile_unit)
+						cu = val;
+					else if (idx == DW_IDX_die_offset)
+						die = val;
+					else if (idx == DW_IDX_type_unit)
+						intu = 1;
+				}
+
+				if (tag != DW_TAG_variable || intu || cu >= numcus || nth--)
+					continue;
+
+				a = cus + cu * osz;
+				*unitoff = dwarf_read(debug, &a, osz);
+				*dieoff = die;
+
+				dprintf("Variable %s found in .debug_names (unit %#lx)\n", name, *unitoff);
+
+				return 0;
+			}
+		}
+
+		p = next;
+	}
+
+	return -ENAVAIL;
+}
+
+static uint32_t gdb_index_hash(const char *name, unsigned int version) {
+	uint32_t hash = 0;
+
+	for (; *name; name++)
+		hash = hash * 67 + (version >= 5 ? tolower((unsigned char)*name) : *name) - 113;
+
+	return hash;
+}
+
+static inline uint32_t gdb_index_u32(const unsigned char *p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* Look up a variable in .gdb_index (always little-endian) */
+static int lookup_gdb_index(struct elfconf_debug *debug, const char *name, unsigned int nth,
+		uint64_t *unitoff) {
+	const unsigned char *index = debug->gdb_index.data, *entryp, *vec;
+	uint32_t version, culist, symtab, pool, slots, hash, slot, step, count, entry, cu;
+	uint32_t numcus, kind, nameoff, vecoff, num;
+
+	if (debug->gdb_index.size < 24)
+		return -ENAVAIL;
+
+	version = gdb_index_u32(index);
+	culist = gdb_index_u32(index + 4);
+	symtab = gdb_index_u32(index + 16);
+	pool = gdb_index_u32(index + 20);
+
+	if (version < 4 || pool > debug->gdb_index.size || symtab > pool)
+		return -ENOTSUP;
+
+	numcus = (gdb_index_u32(index + 8) - culist) / 16;
+	slots = (pool - symtab) / 8;
+	if (!slots || (slots & (slots - 1)))
+		return -EINVAL;
+
+	hash = gdb_index_hash(name, version);
+	slot = hash & (slots - 1);
+	step = ((hash * 17) & (slots - 1)) | 1;
+
+	for (count = 0; count < slots; count++, slot = (slot + step) & (slots - 1)) {
+		entryp = index + symtab + slot * 8;
+		nameoff = gdb_index_u32(entryp);
+		vecoff = gdb_index_u32(entryp + 4);
+
+		if (!nameoff && !vecoff)
+			return -ENAVAIL;
+
+		if (pool + nameoff >= debug->gdb_index.size ||
+			strcmp((const char *)index + pool + nameoff, name))
+			continue;
+
+		vec = index + pool + vecoff;
+		for (num = gdb_index_u32(vec); num; num--) {
+			vec += 4;
+			entry = gdb_index_u32(vec);
+			cu = entry & 0xffffff;
+			kind = (entry >> 28) & 7;
+
+			/* Symbol kinds are available since version 7 */
+			if ((version >= 7 && kind != 2) || cu >= numcus || nth--)
+				continue;
+
+			*unitoff = gdb_index_u32(index + culist + cu * 16) |
+					   (uint64_t)gdb_index_u32(index + culist + cu * 16 + 4) << 32;
+
+			dprintf("Variable %s found in .gdb_index (unit %#lx)\n", name, *unitoff);
+
+			return 0;
+		}
+
+		return -ENAVAIL;
+	}
+
+	return -ENAVAIL;
+}
+
+/*
+ * Whether a DIE describes the variable of the symbol at addr, which may
+ * share its name with static variables of other units.
+ */
+static int match_dwarf_variable(struct elfconf_dwarf_die *var, const char *name,
+		unsigned long addr, int bind) {
+	if (var->tag != DW_TAG_variable || !var->name || strcmp(var->name, name) ||
+		(!var->type && !var->specification))
+		return 0;
+
+	if (var->addr != ELFCONF_DWARF_UNSET)
+		return var->addr == addr;
+
+	/* Declarations and split units have no address, only their linkage */
+	return !var->external == (bind == STB_LOCAL);
+}
+
+/* Find a variable among the top-level DIEs of a unit */
+static int find_dwarf_variable(struct elfconf_dwarf_unit *unit, const char *name,
+		unsigned long addr, int bind, uint64_t dieoff, struct elfconf_dwarf_die *var) {
+	const unsigned char *p;
+
+	if (dieoff != ELFCONF_DWARF_UNSET && read_dwarf_die(unit, unit->start + dieoff, var) &&
+		match_dwarf_variable(var, name, addr, bind))
+		return 0;
+
+	p = read_dwarf_die(unit, unit->dies, var);
+	if (!p || !var->children)
+		return -ENAVAIL;
+
+	while (p) {
+		p = read_dwarf_die(unit, p, var);
+		if (!p || !var->tag)
+			break;
+
+		if (match_dwarf_variable(var, name, addr, bind))
+			return 0;
+
+		if (var->children)
+			p = var->sibling ? var->sibling : skip_dwarf_children(unit, p);
+	}
+
+	return -ENAVAIL;
+}
+
+/* Search a unit, or the .dwo it refers to, for a variable */
+static int find_dwarf_unit_variable(struct elfconf_arguments *args, struct elfconf_dwarf_unit *unit,
+		const char *name, unsigned long addr, int bind, uint64_t dieoff, struct elfconf_dwarf_die *var) {
+	struct elfconf_debug *dwo;
+	const unsigned char *p;
+
+	if (unit->type != DW_UT_skeleton && !find_dwarf_variable(unit, name, addr, bind, dieoff, var))
+		return 0;
+
+	dwo = get_elfconf_dwo(args, unit);
+	if (!dwo)
+		return -ENAVAIL;
+
+	/* Offsets from the index refer to the split unit */
+	for (p = dwo->info.data; p < dwo->info.data + dwo->info.size; p = unit->end) {
+		if (parse_dwarf_unit(dwo, p, unit))
+			return -EINVAL;
+
+		if (unit->type == DW_UT_split_type)
+			continue;
+
+		if (!find_dwarf_variable(unit, name, addr, bind, dieoff, var))
+			return 0;
+	}
+
+	return -ENAVAIL;
+}
+
+/*
+ * Resolve a path like "cfg.net.timeout_ms" to the location of the
+ * member relative to the start of the variable, which is the one of the
+ * symbol at addr with binding bind.
+ */
+static int resolve_elfconf_field(struct elfconf_arguments *args, const char *path,
+		unsigned long addr, int bind, struct elfconf_field *field) {
+	struct elfconf_debug *debug;
+	struct elfconf_dwarf_unit unit;
+	struct elfconf_dwarf_die var;
+	const unsigned char *p;
+	uint64_t unitoff, dieoff;
+	size_t len = strcspn(path, ".[");
+	unsigned int nth;
+	char *name;
+	int ret = -ENAVAIL;
+
+	debug = get_elfconf_debug(args);
+	if (!debug)
+		return -ENAVAIL;
+
+	name = strndup(path, len);
+	if (!name)
+		return -ENOMEM;
+
+	/*
+	 * Accelerated lookup first, trying every unit the indexes list for
+	 * the name. Scanning all units is the last resort.
+	 */
+	for (nth = 0; ret && !lookup_dwarf_names(debug, name, nth, &unitoff, &dieoff); nth++)
+		if (unitoff < debug->info.size && !parse_dwarf_unit(debug, debug->info.data + unitoff, &unit))
+			ret = find_dwarf_unit_variable(args, &unit, name, addr, bind, dieoff, &var);
+
+	for (nth = 0; ret && !lookup_gdb_index(debug, name, nth, &unitoff); nth++)
+		if (unitoff < debug->info.size && !parse_dwarf_unit(debug, debug->info.data + unitoff, &unit))
+			ret = find_dwarf_unit_variable(args, &unit, name, addr, bind, ELFCONF_DWARF_UNSET, &var);
+
+	for (p = debug->info.data; ret && p < debug->info.data + debug->info.size; p = unit.end) {
+		if (parse_dwarf_unit(debug, p, &unit))
+			break;
+
+		ret = find_dwarf_unit_variable(args, &unit, name, addr, bind, ELFCONF_DWARF_UNSET, &var);
+	}
+
+	free(name);
+
+	if (ret)
+		return ret;
+
+	/* Definitions of declared variables refer to the declaration */
+	if (!var.type && read_dwarf_ref(&unit, var.specification, &unit, &var))
+		return -EINVAL;
+
+	if (read_dwarf_ref(&unit, var.type, &unit, &var))
+		return -EINVAL;
+
+	ret = walk_dwarf_path(&unit, &var, path + len, field);
+
+	dprintf("Member %s: offset %#lx, size %lu, bits %u:%u\n", path,
+			field->offset, field->size, field->bit_offset, field->bit_size);
+
+	return ret;
+}
+
+/*
+ * Expressions
+ *
+ * Values may be given as expressions over the ELF being configured:
+ *
+ *   <number>        Integer in C notation (decimal, 0x..., 0...)
+ *   <symbol>        Value of another symbol: the value assigned in the
+ *                   same invocation, otherwise the contents in the ELF
+ *   sizeof(<name>)  Size of a symbol or section
+ *   offset(<name>)  File offset of a symbol or section
+ *   addr(<name>)    Address of a symbol or section
+ *   align(<x>, <n>) <x> rounded up to a multiple of <n>
+ *
+ * with the C operators ( ) ~ ! - * / % + - << >> & ^ | and their usual
+ * precedence. Values referring to each other are evaluated depth-first,
+ * i.e. in topological order, and dependency cycles are rejected.
+ */
+
+static int eval_elfconf_value(struct elfconf_expr *expr, struct elfconf_value *value);
+static int parse_expr_or(struct elfconf_expr *expr, unsigned long *val);
+
+static void expr_skip(struct elfconf_expr *expr) {
+	while (*expr->pos == ' ' || *expr->pos == '\t')
+		expr->pos++;
+}
+
+static int expr_consume(struct elfconf_expr *expr, char *token) {
+	size_t len = strlen(token);
+
+	expr_skip(expr);
+
+	if (strncmp(expr->pos, token, len))
+		return 0;
+
+	expr->pos += len;
+
+	return 1;
+}
+
+static inline int expr_is_name(char c, int first) {
+	if (c == '_' || c == '.' || c == '$')
+		return 1;
+
+	if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+		return 1;
+
+	/* Digits and array indices of member paths */
+	return !first && ((c >= '0' && c <= '9') || c == '[' || c == ']');
+}
+
+static char *expr_name(struct elfconf_expr *expr) {
+	char *start;
+
+	expr_skip(expr);
+
+	for (start = expr->pos; expr_is_name(*expr->pos, expr->pos == start); expr->pos++);
+
+	if (expr->pos == start)
+		return NULL;
+
+	return strndup(start, expr->pos - start);
+}
+
+static int expr_symbol_value(struct elfconf_expr *expr, char *name, unsigned long *val) {
+	struct elfconf_object obj;
+	struct elfconf_value *value;
+	int ret;
+
+	/* Symbols configured in the same invocation */
+	for (value = expr->args->values; value; value = value->next) {
+		if (strcmp(value->sym, name))
+			continue;
+
+		/* Read-modify-write, like flags | 4 */
+		if (value == expr->value)
+			break;
+
+		ret = eval_elfconf_value(expr, value);
+		if (ret)
+			return ret;
+
+		/* Only integers can be used in expressions */
+		if (value->state != ELFCONF_VALUE_DONE)
+			return -EINVAL;
+
+		*val = value->val;
+
+		return 0;
+	}
+
+	ret = expr->lookup(expr->args, expr->elf, name, &obj);
+	if (ret)
+		return ret;
+
+	return read_elfconf_object(expr->args, &obj, val);
+}
+
+static int parse_expr_function(struct elfconf_expr *expr, char *name, unsigned long *val) {
+	struct elfconf_object obj;
+	unsigned long align;
+	char *arg;
+	int ret;
+
+	if (!strcmp(name, "align")) {
+		ret = parse_expr_or(expr, val);
+		if (ret)
+			return ret;
+
+		if (!expr_consume(expr, ","))
+			return -EINVAL;
+
+		ret = parse_expr_or(expr, &align);
+		if (ret)
+			return ret;
+
+		if (!align)
+			return -EDOM;
+
+		*val = (*val + align - 1) / align * align;
+
+		return expr_consume(expr, ")") ? 0 : -EINVAL;
+	}
+
+	arg = expr_name(expr);
+	if (!arg)
+		return -EINVAL;
+
+	ret = expr->lookup(expr->args, expr->elf, arg, &obj);
+	free(arg);
+	if (ret)
+		return ret;
+
+	if (!strcmp(name, "sizeof"))
+		*val = obj.size;
+	else if (!strcmp(name, "offset"))
+		*val = obj.offset;
+	else if (!strcmp(name, "addr"))
+		*val = obj.addr;
+	else
+		return -EINVAL;
+
+	return expr_consume(expr, ")") ? 0 : -EINVAL;
+}
+
+static int parse_expr_primary(struct elfconf_expr *expr, unsigned long *val) {
+	char *name, *end;
+	int ret;
+
+	expr_skip(expr);
+
+	if (expr_consume(expr, "(")) {
+		ret = parse_expr_or(expr, val);
+		if (ret)
+			return ret;
+
+		return expr_consume(expr, ")") ? 0 : -EINVAL;
+	}
+
+	if (*expr->pos >= '0' && *expr->pos <= '9') {
+		errno = 0;
+		*val = strtoull(expr->pos, &end, 0);
+		if (errno)
+			return -errno;
+
+		expr->pos = end;
+
+		return 0;
+	}
+
+	name = expr_name(expr);
+	if (!name)
+		return -EINVAL;
+
+	if (expr_consume(expr, "("))
+		ret = parse_expr_function(expr, name, val);
+	else
+		ret = expr_symbol_value(expr, name, val);
+
+	free(name);
+
+	return ret;
+}
+
+static int parse_expr_unary(struct elfconf_expr *expr, unsigned long *val) {
+	int ret;
+
+	if (expr_consume(expr, "-")) {
+		ret = parse_expr_unary(expr, val);
+		*val = -*val;
+	} else if (expr_consume(expr, "~")) {
+		ret = parse_expr_unary(expr, val);
+		*val = ~*val;
+	} else if (expr_consume(expr, "!")) {
+		ret = parse_expr_unary(expr, val);
+		*val = !*val;
+	} else if (expr_consume(expr, "+")) {
+		ret = parse_expr_unary(expr, val);
+	} else {
+		ret = parse_expr_primary(expr, val);
+	}
+
+	return ret;
+}
+
+static int parse_expr_mul(struct elfconf_expr *expr, unsigned long *val) {
+	unsigned long rhs;
+	char op;
+	int ret;
+
+	ret = parse_expr_unary(expr, val);
+
+	while (!ret) {
+		expr_skip(expr);
+
+		op = *expr->pos;
+		if (op != '*' && op != '/' && op != '%')
+			break;
+
+		expr->pos++;
+		ret = parse_expr_unary(expr, &rhs);
+		if (ret)
+			break;
+
+		if (op != '*' && !rhs)
+			return -EDOM;
+
+		if (op == '*')
+			*val *= rhs;
+		else if (op == '/')
+			*val /= rhs;
+		else
+			*val %= rhs;
+	}
+
+	return ret;
+}
+
+static int parse_expr_add(struct elfconf_expr *expr, unsigned long *val) {
+	unsigned long rhs;
+	char op;
+	int ret;
+
+	ret = parse_expr_mul(expr, val);
+
+	while (!ret) {
+		expr_skip(expr);
+
+		op = *expr->pos;
+		if (op != '+' && op != '-')
+			break;
+
+		expr->pos++;
+		ret = parse_expr_mul(expr, &rhs);
+		if (!ret)
+			*val = op == '+' ? *val + rhs : *val - rhs;
+	}
+
+	return ret;
+}
+
+static int parse_expr_shift(struct elfconf_expr *expr, unsigned long *val) {
+	unsigned long rhs;
+	int ret, left;
+
+	ret = parse_expr_add(expr, val);
+
+	while (!ret) {
+		if (expr_consume(expr, "<<"))
+			left = 1;
+		else if (expr_consume(expr, ">>"))
+			left = 0;
+		else
+			break;
+
+		ret = parse_expr_add(expr, &rhs);
+		if (ret)
+			break;
+
+		if (rhs >= sizeof(*val) * 8)
+			*val = 0;
+		else
+			*val = left ? *val << rhs : *val >> rhs;
+	}
+
+	return ret;
+}
+
+static int parse_expr_and(struct elfconf_expr *expr, unsigned long *val) {
+	unsigned long rhs;
+	int ret;
+
+	ret = parse_expr_shift(expr, val);
+
+	while (!ret && expr_consume(expr, "&")) {
+		ret = parse_expr_shift(expr, &rhs);
+		*val &= rhs;
+	}
+
+	return ret;
+}
+
+static int parse_expr_xor(struct elfconf_expr *expr, unsigned long *val) {
+	unsigned long rhs;
+	int ret;
+
+	ret = parse_expr_and(expr, val);
+
+	while (!ret && expr_consume(expr, "^")) {
+		ret = parse_expr_and(expr, &rhs);
+		*val ^= rhs;
+	}
+
+	return ret;
+}
+
+static int parse_expr_or(struct elfconf_expr *expr, unsigned long *val) {
+	unsigned long rhs;
+	int ret;
+
+	ret = parse_expr_xor(expr, val);
+
+	while (!ret && expr_consume(expr, "|")) {
+		ret = parse_expr_xor(expr, &rhs);
+		*val |= rhs;
+	}
+
+	return ret;
+}
+
+static int eval_elfconf_expr(struct elfconf_expr *expr, char *text, unsigned long *val) {
+	struct elfconf_expr sub = *expr;
+	int ret;
+
+	sub.pos = text;
+	ret = parse_expr_or(&sub, val);
+	if (ret)
+		return ret;
+
+	/* Trailing garbage */
+	expr_skip(&sub);
+
+	return *sub.pos ? -EINVAL : 0;
+}
+
+static inline int is_elfconf_list(struct elfconf_value *value) {
+	return value->expr[strspn(value->expr, " \t")] == '{';
+}
+
+/* Messages for errors in expressions and values */
+static const char *elfconf_value_error(int err) {
+	switch (err) {
+		case -ELOOP:
+			return "cyclic reference";
+		case -EDOM:
+			return "division by zero";
+		case -EINVAL:
+			return "invalid expression";
+		case -ENAVAIL:
+			return "unknown symbol or section";
+		case -ENODATA:
+			return "unknown element size, use -w";
+		case -ERANGE:
+			return "does not fit the symbol";
+		default:
+			return strerror(-err);
+	}
+}
+
+static int eval_elfconf_value(struct elfconf_expr *expr, struct elfconf_value *value) {
+	struct elfconf_expr sub = *expr;
+	int ret;
+
+	if (value->state == ELFCONF_VALUE_DONE)
+		return 0;
+
+	/* Value depends on itself */
+	if (value->state == ELFCONF_VALUE_EVALUATING)
+		return -ELOOP;
+
+	/* Lists, floats and strings are encoded along with the symbol */
+	if (value->type == ELFCONF_TYPE_FLOAT || value->type == ELFCONF_TYPE_STRING ||
+		is_elfconf_list(value))
+		return 0;
+
+	value->state = ELFCONF_VALUE_EVALUATING;
+
+	sub.value = value;
+	ret = eval_elfconf_expr(&sub, value->expr, &value->val);
+	if (ret) {
+		fprintf(stderr, "elfconf: cannot evaluate '%s' for %s: %s\n",
+				value->expr, value->sym, elfconf_value_error(ret));
+		return ret;
+	}
+
+	value->state = ELFCONF_VALUE_DONE;
+
+	dprintf("Value of symbol %s: %#lx\n", value->sym, value->val);
+
+	return 0;
+}
+
+static int eval_elfconf_values(struct elfconf_expr *expr) {
+	struct elfconf_value *value;
+
+	for (value = expr->args->values; value; value = value->next)
+		if (eval_elfconf_value(expr, value))
+			return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * Values
+ *
+ * Values are encoded in the byte order of the ELF before anything is
+ * written. The width of each element is, in this order, given by -w,
+ * the element size of arrays from DWARF or the size of the symbol:
+ *
+ *   <value>          One element, written at the start of the symbol
+ *   {<v>, <v>, ...}  One value per element, remaining elements are zeroed
+ *
+ * With -F, the encoded elements are repeated across the whole symbol.
+ * Strings are padded with NULs to the element width, or to the size of
+ * the symbol if it is a single string.
+ */
+
+/* Replicate a pattern across dst by doubling the filled part */
+static void fill_elfconf_pattern(unsigned char *dst, size_t size, const unsigned char *pattern,
+		size_t len) {
+	size_t done, chunk, copy;
+
+	if (len == 1) {
+		memset(dst, *pattern, size);
+		return;
+	}
+
+	done = len < size ? len : size;
+	memcpy(dst, pattern, done);
+
+	/*
+	 * Large copies let memcpy() use its widest stores. Chunks are kept
+	 * small enough for the source to stay in the cache.
+	 */
+	chunk = ELFCONF_FILL_CHUNK > len ? ELFCONF_FILL_CHUNK / len * len : len;
+
+	while (done < size) {
+		copy = done < chunk ? done : chunk;
+		if (copy > size - done)
+			copy = size - done;
+
+		memcpy(dst + done, dst, copy);
+		done += copy;
+	}
+}
+
+static void encode_elfconf_integer(struct elfconf_arguments *args, unsigned char *dst,
+		unsigned int width, unsigned long val, int sign) {
+	unsigned char *ident = args->buf, ext;
+	unsigned int i;
+
+	/* Sign or zero extension beyond 64 bits */
+	ext = sign && (long)val < 0 ? 0xff : 0x00;
+
+	for (i = 0; i < width; i++) {
+		if (ident[EI_DATA] == ELFDATA2MSB)
+			dst[width - 1 - i] = i < sizeof(val) ? val >> (i * 8) : ext;
+		else
+			dst[i] = i < sizeof(val) ? val >> (i * 8) : ext;
+	}
+}
+
+/* Strings may be quoted, which is required in lists */
+static char *elfconf_string(char *text, size_t *len) {
+	text += strspn(text, " \t");
+	*len = strlen(text);
+
+	if (*len >= 2 && text[0] == '"' && text[*len - 1] == '"') {
+		*len -= 2;
+		return text + 1;
+	}
+
+	return text;
+}
+
+static int encode_elfconf_element(struct elfconf_expr *expr, struct elfconf_value *value,
+		char *text, unsigned char *dst, unsigned int width) {
+	unsigned long val;
+	uint32_t single;
+	uint64_t dbl;
+	double num;
+	size_t len;
+	char *end;
+	int ret;
+
+	switch (value->type) {
+		case ELFCONF_TYPE_FLOAT:
+			errno = 0;
+			num = strtod(text, &end);
+			if (errno || end == text || end[strspn(end, " \t")])
+				return -EINVAL;
+
+			if (width == sizeof(float)) {
+				float flt = num;
+				memcpy(&single, &flt, sizeof(single));
+				encode_elfconf_integer(expr->args, dst, width, single, 0);
+			} else if (width == sizeof(double)) {
+				memcpy(&dbl, &num, sizeof(dbl));
+				encode_elfconf_integer(expr->args, dst, width, dbl, 0);
+			} else {
+				return -EINVAL;
+			}
+
+			return 0;
+		case ELFCONF_TYPE_STRING:
+			text = elfconf_string(text, &len);
+			if (len > width)
+				return -ERANGE;
+
+			memcpy(dst, text, len);
+			memset(dst + len, 0, width - len);
+
+			return 0;
+		default:
+			ret = eval_elfconf_expr(expr, text, &val);
+			if (ret)
+				return ret;
+
+			encode_elfconf_integer(expr->args, dst, width, val, value->type == ELFCONF_TYPE_SIGNED);
+
+			return 0;
+	}
+}
+
+/* Split a list into its elements, in place */
+static int split_elfconf_list(char *list, char ***elems, size_t *count) {
+	char **array, *p, quote = 0;
+	size_t max = 0;
+	int depth = 0;
+
+	list = strchr(list, '{') + 1;
+	p = list + strlen(list);
+
+	while (p > list && (p[-1] == ' ' || p[-1] == '\t'))
+		p--;
+
+	if (p == list || p[-1] != '}')
+		return -EINVAL;
+
+	p[-1] = '\0';
+
+	*elems = NULL;
+	*count = 0;
+
+	for (p = list; ; p++) {
+		if (quote) {
+			if (*p == quote)
+				quote = 0;
+			else if (!*p)
+				return -EINVAL;
+			continue;
+		}
+
+		if (*p == '"')
+			quote = *p;
+		else if (*p == '(')
+			depth++;
+		else if (*p == ')')
+			depth--;
+
+		if ((*p != ',' || depth) && *p)
+			continue;
+
+		if (*count == max) {
+			max = max ? max * 2 : 16;
+			array = realloc(*elems, max * sizeof(*array));
+			if (!array) {
+				free(*elems);
+				return -ENOMEM;
+			}
+
+			*elems = array;
+		}
+
+		(*elems)[(*count)++] = list;
+
+		if (!*p)
+			break;
+
+		*p = '\0';
+		list = p + 1;
+	}
+
+	/* Allow a trailing comma, like C initializers */
+	if (*count && !(*elems)[*count - 1][strspn((*elems)[*count - 1], " \t")])
+		(*count)--;
+
+	return 0;
+}
+
+/*
+ * Encode the value of a symbol whose location has been looked up in
+ * value->obj. Bitfields are read-modify-written when stored instead.
+ */
+static int encode_elfconf_value(struct elfconf_expr *expr, struct elfconf_value *value) {
+	struct elfconf_object *obj = &value->obj;
+	struct elfconf_field field;
+	unsigned char *pattern;
+	unsigned int width = value->width;
+	size_t count = 1, index, len;
+	char **elems, *list = NULL;
+	int ret;
+
+	if (obj->bit_size) {
+		if (value->state != ELFCONF_VALUE_DONE || value->width || value->fill)
+			return -EINVAL;
+
+		return 0;
+	}
+
+	if (is_elfconf_list(value)) {
+		list = strdup(value->expr);
+		if (!list)
+			return -ENOMEM;
+
+		ret = split_elfconf_list(list, &elems, &count);
+		if (ret) {
+			free(list);
+			return ret;
+		}
+	} else {
+		elems = &value->expr;
+	}
+
+	/* Element size of arrays from DWARF, if the symbol has any */
+	if (!width && !obj->elem_size && (list || value->fill) &&
+		value->type != ELFCONF_TYPE_STRING &&
+		!resolve_elfconf_field(expr->args, value->sym, obj->symaddr, obj->bind, &field))
+		obj->elem_size = field.elem_size;
+
+	/* Unless given on the command line, the width follows the symbol */
+	if (!width) {
+		if (value->type == ELFCONF_TYPE_STRING && list) {
+			/* One string per row, like char names[4][16], needs DWARF or -w */
+			if (!resolve_elfconf_field(expr->args, value->sym, obj->symaddr, obj->bind, &field))
+				width = field.row_size;
+		} else if (value->type == ELFCONF_TYPE_STRING && value->fill) {
+			elfconf_string(value->expr, &len);
+			width = len;
+		} else if (value->type == ELFCONF_TYPE_STRING) {
+			width = obj->size;
+		} else if (list || value->fill) {
+			width = obj->elem_size ? obj->elem_size : obj->size;
+		} else {
+			width = obj->size;
+		}
+	}
+
+	if (!width) {
+		ret = -ENODATA;
+		goto out;
+	}
+
+	len = count * width;
+	if (len / width != count || len > obj->size ||
+		(value->type != ELFCONF_TYPE_STRING && width > 16)) {
+		ret = -ERANGE;
+		goto out;
+	}
+
+	/* A list covers the whole symbol, a single value only its width */
+	value->size = list || value->fill ? obj->size : len;
+	value->data = calloc(1, value->size);
+	if (!value->data) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	pattern = value->fill ? malloc(len) : value->data;
+	if (!pattern) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (index = 0, ret = 0; index < count && !ret; index++) {
+		if (!list && value->state == ELFCONF_VALUE_DONE)
+			encode_elfconf_integer(expr->args, pattern, width, value->val,
+								   value->type == ELFCONF_TYPE_SIGNED);
+		else
+			ret = encode_elfconf_element(expr, value, elems[index], pattern + index * width, width);
+	}
+
+	if (value->fill) {
+		if (!ret)
+			fill_elfconf_pattern(value->data, value->size, pattern, len);
+		free(pattern);
+	}
+
+out:
+	if (list) {
+		free(elems);
+		free(list);
+	}
+
+	if (ret)
+		fprintf(stderr, "elfconf: cannot encode '%s' for %s: %s\n",
+				value->expr, value->sym, elfconf_value_error(ret));
+
+	return ret;
+}
+
+static int store_elfconf_value(struct elfconf_arguments *args, struct elfconf_value *value) {
+	/* Bitfields share bytes with other members, modify them in place */
+	if (value->obj.bit_size)
+		return write_elfconf_object(args, &value->obj, value->val);
+
+	return write_elfconf_file(args, value->obj.offset, value->data, value->size);
+}
+
+/*
+ * Symbol index
+ *
+ * With -S, the symbols are looked up in all objects below the search
+ * paths (and, with -N, in the libraries they need) instead of a single
+ * ELF. The objects are scanned in parallel. Only the requested names are
+ * indexed: they are hashed into a table which is read-only while the
+ * objects are scanned, and the definitions found for each name are
+ * guarded by the lock of its partition of the hash.
+ */
+
+/* FNV-1a */
+static uint32_t elfconf_hash(const char *name, size_t len) {
+	uint32_t hash = 2166136261u;
+
+	while (len--)
+		hash = (hash ^ (unsigned char)*name++) * 16777619u;
+
+	return hash;
+}
+
+/* Slot of a name in the index, empty if the name has not been requested */
+static struct elfconf_name *find_elfconf_name(struct elfconf_search *search, const char *name,
+		size_t len, uint32_t hash) {
+	struct elfconf_name *slot;
+	size_t mask = search->numnames - 1, i;
+
+	for (i = hash & mask; ; i = (i + 1) & mask) {
+		slot = &search->names[i];
+
+		if (!slot->name)
+			return slot;
+
+		if (slot->hash == hash && slot->len == len && !memcmp(slot->name, name, len))
+			return slot;
+	}
+}
+
+static void add_elfconf_name(struct elfconf_search *search, char *name, size_t len) {
+	uint32_t hash = elfconf_hash(name, len);
+	struct elfconf_name *slot;
+
+	slot = find_elfconf_name(search, name, len, hash);
+	if (slot->name)
+		return;
+
+	slot->name = name;
+	slot->len = len;
+	slot->hash = hash;
+}
+
+/* Slot of a requested symbol, members are defined along with their symbol */
+static struct elfconf_name *get_elfconf_name(struct elfconf_search *search, char *sym) {
+	size_t len = strlen(sym), base = strcspn(sym, ".[");
+	struct elfconf_name *slot;
+
+	slot = find_elfconf_name(search, sym, len, elfconf_hash(sym, len));
+	if (slot->defs || !base || base == len)
+		return slot;
+
+	return find_elfconf_name(search, sym, base, elfconf_hash(sym, base));
+}
+
+/* Called concurrently for every symbol defined in the objects */
+static int add_elfconf_definition(struct elfconf_search *search, size_t file, const char *name, int bind) {
+	struct elfconf_definition *def, **pos;
+	struct elfconf_name *slot;
+	pthread_mutex_t *lock;
+	size_t len = strlen(name);
+	uint32_t hash;
+
+	hash = elfconf_hash(name, len);
+	slot = find_elfconf_name(search, name, len, hash);
+	if (!slot->name)
+		return 0;
+
+	lock = &search->locks[hash % ELFCONF_INDEX_PARTITIONS];
+	pthread_mutex_lock(lock);
+
+	/* Keep the load order, objects are scanned in any order */
+	for (pos = &slot->defs; *pos && (*pos)->file < file; pos = &(*pos)->next);
+
+	/* Same name in multiple compilation units of one object */
+	if (*pos && (*pos)->file == file) {
+		if (bind != STB_LOCAL)
+			(*pos)->bind = bind;
+
+		pthread_mutex_unlock(lock);
+
+		return 0;
+	}
+
+	def = malloc(sizeof(*def));
+	if (def) {
+		def->file = file;
+		def->bind = bind;
+		def->next = *pos;
+		*pos = def;
+	}
+
+	pthread_mutex_unlock(lock);
+
+	return def ? 0 : -ENOMEM;
+}
+
+/*
+ * 32-bit ELF functions
+ */
+
+static Elf32_Shdr *find_elf32_section_header(struct elfconf_elf32file *elf, char *name) {
+	Elf32_Shdr *section;
+	unsigned int shndx;
+
+	for (shndx = 0; shndx < elf->ehdr->e_shnum; shndx++) {
+		section = elf_section_header(elf, shndx);
+
+		if (!strcmp(name, elf_section_name(elf, section->sh_name)))
+			return section;
+	}
+
+	return NULL;
+}
+
+static void *find_elf32_section(struct elfconf_elf32file *elf, char *name, unsigned int *num) {
+	Elf32_Shdr *section;
+
+	section = find_elf32_section_header(elf, name);
+	if (!section)
+		return NULL;
+
+	/* Entries of symbol tables, bytes of string tables */
+	if (num)
+		*num = section->sh_entsize ? section->sh_size / section->sh_entsize : section->sh_size;
+
+	return elf->head + section->sh_offset;
+}
+
+static int parse_elf32_file(void *buf, struct elfconf_elf32file *elf) {
+	/* Initialize pointers to section headers */
+	elf->ehdr = buf;
+	elf->shdr = buf + elf->ehdr->e_shoff;
+
+	/* Assign .shstrtab section first */
+	elf->shstrtab = elf_section(elf, elf->ehdr->e_shstrndx);
+
+	/* Search for .symtab and .strtab section */
+	elf->symtab = find_elf32_section(elf, ELFCONF_SECTION_SYMTAB, &elf->numsyms);
+	elf->strtab = find_elf32_section(elf, ELFCONF_SECTION_STRTAB, &elf->strsize);
+
+	/* Stripped objects only have their dynamic symbols left */
+	if (!elf->symtab || !elf->strtab) {
+		elf->symtab = find_elf32_section(elf, ELFCONF_SECTION_DYNSYM, &elf->numsyms);
+		elf->strtab = find_elf32_section(elf, ELFCONF_SECTION_DYNSTR, &elf->strsize);
+	}
+
+	if (!elf->symtab || !elf->strtab)
+		return -ENAVAIL;
+
+	return 0;
+}
+
+static Elf32_Sym *find_elf32_symbol(struct elfconf_elf32file *elf, char *name, int exported) {
+	Elf32_Sym *symbol;
+	unsigned int index;
+
+	for(index = 0; index < elf->numsyms; index++) {
+		symbol = elf_symbol(elf, index);
+		if (symbol->st_name >= elf->strsize || strcmp(name, elf_symbol_name(elf, symbol)))
+			continue;
+
+		if (exported && elf_symbol_bind(symbol) == STB_LOCAL)
+			continue;
+
+		if (symbol->st_shndx == SHN_UNDEF)
+			return NULL;
+
+		print_elf32_symbol_info(elf, symbol);
+
+		return symbol;
+	}
+
+	return NULL;
+}
+
+static int lookup_elf32_symbol(struct elfconf_arguments *args, void *ptr, char *name,
+		struct elfconf_object *obj, int exported) {
+	struct elfconf_elf32file *elf = ptr;
+	struct elfconf_field field = { 0 };
+	Elf32_Shdr *section;
+	Elf32_Sym *symbol;
+	char *path, *base;
+
+	memset(obj, 0, sizeof(*obj));
+
+	/* Symbols take precedence over sections of the same name */
+	symbol = find_elf32_symbol(elf, name, exported);
+
+	/* Member of a symbol, e.g. cfg.net.timeout_ms */
+	path = strpbrk(name, ".[");
+	if (!symbol && path && path != name) {
+		base = strndup(name, path - name);
+		if (!base)
+			return -ENOMEM;
+
+		symbol = find_elf32_symbol(elf, base, exported);
+		free(base);
+
+		if (!symbol || symbol->st_shndx >= SHN_LORESERVE ||
+			resolve_elfconf_field(args, name, symbol->st_value, elf_symbol_bind(symbol), &field))
+			return -ENAVAIL;
+	} else {
+		path = NULL;
+	}
+
+	if (symbol) {
+		obj->symaddr = symbol->st_value;
+		obj->bind = elf_symbol_bind(symbol);
+	}
+
+	if (symbol && symbol->st_shndx < SHN_LORESERVE) {
+		section = elf_section_header(elf, symbol->st_shndx);
+		obj->addr = symbol->st_value;
+		obj->offset = elf_symbol_offset(elf, symbol);
+		obj->size = symbol->st_size;
+	} else if (symbol) {
+		/* Absolute and common symbols have no place in the file */
+		obj->addr = symbol->st_value;
+		obj->offset = 0;
+		obj->size = symbol->st_size;
+		obj->data = NULL;
+
+		return 0;
+	} else {
+		section = find_elf32_section_header(elf, name);
+		if (!section)
+			return -ENAVAIL;
+
+		obj->addr = section->sh_addr;
+		obj->offset = section->sh_offset;
+		obj->size = section->sh_size;
+		obj->section = 1;
+	}
+
+	if (path) {
+		if (field.offset + field.size > obj->size)
+			return -ERANGE;
+
+		obj->addr += field.offset;
+		obj->offset += field.offset;
+		obj->size = field.size;
+		obj->elem_size = field.elem_size;
+		obj->bit_offset = field.bit_offset;
+		obj->bit_size = field.bit_size;
+	}
+
+	obj->data = section->sh_type != SHT_NOBITS ? elf->head + obj->offset : NULL;
+
+	return 0;
+}
+
+static int lookup_elf32_object(struct elfconf_arguments *args, void *ptr, char *name,
+		struct elfconf_object *obj) {
+	return lookup_elf32_symbol(args, ptr, name, obj, 0);
+}
+
+static int configure_elf32_symbol(struct elfconf_arguments *args, struct elfconf_elf32file *elf,
+		struct elfconf_value *value) {
+	struct elfconf_expr expr = { args, elf, lookup_elf32_object };
+
+	/* Only symbols and their members can be configured */
+	if (lookup_elf32_symbol(args, elf, value->sym, &value->obj, value->exported) || value->obj.section) {
+		fprintf(stderr, "elfconf: symbol %s not found in %s\n", value->sym, args->elf);
+		return -ENAVAIL;
+	}
+
+	/* Absolute, common and .bss symbols have no contents in the file */
+	if (!value->obj.data) {
+		fprintf(stderr, "elfconf: symbol %s has no contents in %s\n", value->sym, args->elf);
+		return -ENAVAIL;
+	}
+
+	/* Encode the new value for the specified symbol */
+	if (encode_elfconf_value(&expr, value))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int configure_elf32_symbols(struct elfconf_arguments *args, struct elfconf_elf32file *elf) {
+	struct elfconf_expr expr = { args, elf, lookup_elf32_object };
+	struct elfconf_value *value;
+
+	/* Evaluate all values before the ELF is modified */
+	if (eval_elfconf_values(&expr))
+		return -EINVAL;
+
+	for (value = args->values; value; value = value->next)
+		if (configure_elf32_symbol(args, elf, value))
+			return -ENAVAIL;
+
+	return 0;
+}
+
+static int resolve_elf32_note(struct elfconf_elf32file *elf, char *name, struct elfconf_checksum *csum) {
+	const unsigned char *ident = elf->head, *note;
+	struct elfconf_debug order = { .msb = ident[EI_DATA] == ELFDATA2MSB };
+	Elf32_Shdr *section;
+	uint32_t namesz;
+
+	section = find_elf32_section_header(elf, name);
+	if (!section || section->sh_type != SHT_NOTE)
+		return -ENAVAIL;
+
+	if (section->sh_size < sizeof(Elf32_Nhdr))
+		return -EINVAL;
+
+	/* The digest is the descriptor of the first note, in the byte order of the ELF */
+	note = elf->head + section->sh_offset;
+	namesz = dwarf_read(&order, &note, 4);
+	if (namesz > section->sh_size)
+		return -EINVAL;
+
+	csum->hoff = section->sh_offset + sizeof(Elf32_Nhdr) + ((namesz + 3) & ~3);
+	csum->hsize = dwarf_read(&order, &note, 4);
+
+	if (csum->hoff + csum->hsize > section->sh_offset + section->sh_size)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int resolve_elf32_checksum(struct elfconf_arguments *args, struct elfconf_elf32file *elf,
+		struct elfconf_checksum *csum) {
+	Elf32_Shdr *section;
+	Elf32_Sym *symbol;
+	int ret;
+
+	if (csum->type == ELFCONF_CHECKSUM_BUILDID) {
+		/* The build-id covers the whole file */
+		csum->offset = 0;
+		csum->size = args->size;
+
+		ret = resolve_elf32_note(elf, ELFCONF_SECTION_BUILDID, csum);
+		if (ret)
+			return ret;
+
+		/* Truncated SHA-256, so the length of the build-id is kept */
+		if (csum->hsize > sizeof(csum->digest))
+			csum->hsize = sizeof(csum->digest);
+
+		return 0;
+	}
+
+	section = find_elf32_section_header(elf, csum->section);
+	if (!section)
+		return -ENOENT;
+
+	if (section->sh_type == SHT_NOBITS)
+		return -ENODATA;
+
+	csum->offset = section->sh_offset;
+	csum->size = section->sh_size;
+
+	if (csum->type == ELFCONF_CHECKSUM_SHA256) {
+		ret = resolve_elf32_note(elf, csum->target, csum);
+		if (ret)
+			return ret;
+
+		if (csum->hsize < 32)
+			return -ERANGE;
+
+		csum->hsize = 32;
+
+		return 0;
+	}
+
+	symbol = find_elf32_symbol(elf, csum->target, 0);
+	if (!symbol)
+		return -ENAVAIL;
+
+	if (symbol->st_size < 4)
+		return -ERANGE;
+
+	/* The CRC has to be stored in the file */
+	if (symbol->st_shndx >= SHN_LORESERVE)
+		return -ENODATA;
+
+	section = elf_section_header(elf, symbol->st_shndx);
+	if (section->sh_type == SHT_NOBITS)
+		return -ENODATA;
+
+	csum->hoff = elf_symbol_offset(elf, symbol);
+	csum->hsize = 4;
+
+	return 0;
+}
+
+/*
+ * Objects in the search paths can be anything: section headers and
+ * sections have to lie within the file, and section names have to be
+ * terminated, before any of them is used.
+ */
+static int check_elf32_file(void *buf, size_t size) {
+	Elf32_Ehdr *ehdr = buf;
+	Elf32_Shdr *shdr, *names;
+	unsigned int shndx;
+
+	if (size < sizeof(*ehdr) || ehdr->e_ident[EI_DATA] != ELFCONF_HOST_DATA ||
+		ehdr->e_shentsize != sizeof(*shdr) || ehdr->e_shstrndx >= ehdr->e_shnum ||
+		ehdr->e_shoff > size || ehdr->e_shnum * sizeof(*shdr) > size - ehdr->e_shoff)
+		return -EINVAL;
+
+	shdr = buf + ehdr->e_shoff;
+
+	for (shndx = 0; shndx < ehdr->e_shnum; shndx++) {
+		if (shdr[shndx].sh_type != SHT_NOBITS &&
+			(shdr[shndx].sh_offset > size || shdr[shndx].sh_size > size - shdr[shndx].sh_offset))
+			return -EINVAL;
+
+		if ((shdr[shndx].sh_type == SHT_SYMTAB || shdr[shndx].sh_type == SHT_DYNSYM) &&
+			shdr[shndx].sh_entsize != sizeof(Elf32_Sym))
+			return -EINVAL;
+	}
+
+	names = &shdr[ehdr->e_shstrndx];
+	if (names->sh_type == SHT_NOBITS || !names->sh_size ||
+		((char *)buf)[names->sh_offset + names->sh_size - 1])
+		return -EINVAL;
+
+	for (shndx = 0; shndx < ehdr->e_shnum; shndx++)
+		if (shdr[shndx].sh_name >= names->sh_size)
+			return -EINVAL;
+
+	return 0;
+}
+
+static int index_elf32_symbols(struct elfconf_search *search, size_t file, void *buf, size_t size) {
+	struct elfconf_elf32file elf;
+	Elf32_Shdr *section;
+	Elf32_Sym *symbol;
+	unsigned int index;
+
+	/* Headers have been checked by check_elfconf_file(), objects without symbols define nothing */
+	if (parse_elf32_file(buf, &elf) || (void *)(elf.symtab + elf.numsyms) > buf + size)
+		return 0;
+
+	/* Symbol names are compared with strcmp() as well */
+	if (!elf.strsize || (void *)(elf.strtab + elf.strsize) > buf + size || elf.strtab[elf.strsize - 1])
+		return 0;
+
+	for (index = 0; index < elf.numsyms; index++) {
+		symbol = elf_symbol(&elf, index);
+
+		/*
+		 * Only symbols with contents in the object can be configured,
+		 * which also skips the symbols of separate debug files.
+		 */
+		if (symbol->st_shndx == SHN_UNDEF || symbol->st_shndx >= elf.ehdr->e_shnum || !symbol->st_name ||
+			symbol->st_name >= elf.strsize)
+			continue;
+
+		section = elf_section_header(&elf, symbol->st_shndx);
+		if (section->sh_type == SHT_NOBITS)
+			continue;
+
+		if (add_elfconf_definition(search, file, elf_symbol_name(&elf, symbol), elf_symbol_bind(symbol)))
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static int apply_elf32_args(struct elfconf_arguments *args) {
+	struct elfconf_elf32file elf;
+	struct elfconf_checksum *csum, **pos;
+	int ret;
+
+	/* Fill up data structure */
+	if (parse_elf32_file(args->buf, &elf))
+		return -EFAULT;
+
+	/* Locate checksums before anything is written */
+	for (pos = &args->csums; (csum = *pos); ) {
+		ret = resolve_elf32_checksum(args, &elf, csum);
+		if (!ret) {
+			pos = &csum->next;
+			continue;
+		}
+
+		/* Not every object found in the search paths has all checksums */
+		if (!args->search) {
+			report_elfconf_checksum(args, csum, ret);
+			return -EFAULT;
+		}
+
+		*pos = csum->next;
+		free(csum->states);
+		free(csum);
+	}
+
+	/* Search symbols and encode their values, see store_elfconf_file() */
+	if (configure_elf32_symbols(args, &elf))
+		return -EFAULT;
+
+	return 0;
+}
+
+/*
+ * 64-bit ELF functions
+ */
+
+static Elf64_Shdr *find_elf64_section_header(struct elfconf_elf64file *elf, char *name) {
+	Elf64_Shdr *section;
+	unsigned int shndx;
+
+	for (shndx = 0; shndx < elf->ehdr->e_shnum; shndx++) {
+		section = elf_section_header(elf, shndx);
+
+		if (!strcmp(name, elf_section_name(elf, section->sh_name)))
+			return section;
+	}
+
+	return NULL;
+}
+
+static void *find_elf64_section(struct elfconf_elf64file *elf, char *name, unsigned int *num) {
+	Elf64_Shdr *section;
+
+	section = find_elf64_section_header(elf, name);
+	if (!section)
+		return NULL;
+
+	/* Entries of symbol tables, bytes of string tables */
+	if (num)
+		*num = section->sh_entsize ? section->sh_size / section->sh_entsize : section->sh_size;
+
+	return elf->head + section->sh_offset;
+}
+
+static int parse_elf64_file(void *buf, struct elfconf_elf64file *elf) {
+	/* Initialize pointers to section headers */
+	elf->ehdr = buf;
+	elf->shdr = buf + elf->ehdr->e_shoff;
+
+	/* Assign .shstrtab section first */
+	elf->shstrtab = elf_section(elf, elf->ehdr->e_shstrndx);
+
+	/* Search for .symtab and .strtab section */
+	elf->symtab = find_elf64_section(elf, ELFCONF_SECTION_SYMTAB, &elf->numsyms);
+	elf->strtab = find_elf64_section(elf, ELFCONF_SECTION_STRTAB, &elf->strsize);
+
+	/* Stripped objects only have their dynamic symbols left */
+	if (!elf->symtab || !elf->strtab) {
+		elf->symtab = find_elf64_section(elf, ELFCONF_SECTION_DYNSYM, &elf->numsyms);
+		elf->strtab = find_elf64_section(elf, ELFCONF_SECTION_DYNSTR, &elf->strsize);
+	}
+
+	if (!elf->symtab || !elf->strtab)
+		return -ENAVAIL;
+
+	return 0;
+}
+
+static Elf64_Sym *find_elf64_symbol(struct elfconf_elf64file *elf, char *name, int exported) {
+	Elf64_Sym *symbol;
+	unsigned int index;
+
+	for(index = 0; index < elf->numsyms; index++) {
+		symbol = elf_symbol(elf, index);
+		if (symbol->st_name >= elf->strsize || strcmp(name, elf_symbol_name(elf, symbol)))
+			continue;
+
+		if (exported && elf_symbol_bind(symbol) == STB_LOCAL)
+			continue;
+
+		if (symbol->st_shndx == SHN_UNDEF)
+			return NULL;
+
+		print_elf64_symbol_info(elf, symbol);
+
+		return symbol;
+	}
+
+	return NULL;
+}
+
+static int lookup_elf64_symbol(struct elfconf_arguments *args, void *ptr, char *name,
+		struct elfconf_object *obj, int exported) {
+	struct elfconf_elf64file *elf = ptr;
+	struct elfconf_field field = { 0 };
+	Elf64_Shdr *section;
+	Elf64_Sym *symbol;
+	char *path, *base;
+
+	memset(obj, 0, sizeof(*obj));
+
+	/* Symbols take precedence over sections of the same name */
+	symbol = find_elf64_symbol(elf, name, exported);
+
+	/* Member of a symbol, e.g. cfg.net.timeout_ms */
+	path = strpbrk(name, ".[");
+	if (!symbol && path && path != name) {
+		base = strndup(name, path - name);
+		if (!base)
+			return -ENOMEM;
+
+		symbol = find_elf64_symbol(elf, base, exported);
+		free(base);
+
+		if (!symbol || symbol->st_shndx >= SHN_LORESERVE ||
+			resolve_elfconf_field(args, name, symbol->st_value, elf_symbol_bind(symbol), &field))
+			return -ENAVAIL;
+	} else {
+		path = NULL;
+	}
+
+	if (symbol) {
+		obj->symaddr = symbol->st_value;
+		obj->bind = elf_symbol_bind(symbol);
+	}
+
+	if (symbol && symbol->st_shndx < SHN_LORESERVE) {
+		section = elf_section_header(elf, symbol->st_shndx);
+		obj->addr = symbol->st_value;
+		obj->offset = elf_symbol_offset(elf, symbol);
+		obj->size = symbol->st_size;
+	} else if (symbol) {
+		/* Absolute and common symbols have no place in the file */
+		obj->addr = symbol->st_value;
+		obj->offset = 0;
+		obj->size = symbol->st_size;
+		obj->data = NULL;
+
+		return 0;
+	} else {
+		section = find_elf64_section_header(elf, name);
+		if (!section)
+			return -ENAVAIL;
+
+		obj->addr = section->sh_addr;
+		obj->offset = section->sh_offset;
+		obj->size = section->sh_size;
+		obj->section = 1;
+	}
+
+	if (path) {
+		if (field.offset + field.size > obj->size)
+			return -ERANGE;
+
+		obj->addr += field.offset;
+		obj->offset += field.offset;
+		obj->size = field.size;
+		obj->elem_size = field.elem_size;
+		obj->bit_offset = field.bit_offset;
+		obj->bit_size = field.bit_size;
+	}
+
+	obj->data = section->sh_type != SHT_NOBITS ? elf->head + obj->offset : NULL;
+
+	return 0;
+}
+
+static int lookup_elf64_object(struct elfconf_arguments *args, void *ptr, char *name,
+		struct elfconf_object *obj) {
+	return lookup_elf64_symbol(args, ptr, name, obj, 0);
+}
+
+static int configure_elf64_symbol(struct elfconf_arguments *args, struct elfconf_elf64file *elf,
+		struct elfconf_value *value) {
+	struct elfconf_expr expr = { args, elf, lookup_elf64_object };
+
+	/* Only symbols and their members can be configured */
+	if (lookup_elf64_symbol(args, elf, value->sym, &value->obj, value->exported) || value->obj.section) {
+		fprintf(stderr, "elfconf: symbol %s not found in %s\n", value->sym, args->elf);
+		return -ENAVAIL;
+	}
+
+	/* Absolute, common and .bss symbols have no contents in the file */
+	if (!value->obj.data) {
+		fprintf(stderr, "elfconf: symbol %s has no contents in %s\n", value->sym, args->elf);
+		return -ENAVAIL;
+	}
+
+	/* Encode the new value for the specified symbol */
+	if (encode_elfconf_value(&expr, value))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int configure_elf64_symbols(struct elfconf_arguments *args, struct elfconf_elf64file *elf) {
+	struct elfconf_expr expr = { args, elf, lookup_elf64_object };
+	struct elfconf_value *value;
+
+	/* Evaluate all values before the ELF is modified */
+	if (eval_elfconf_values(&expr))
+		return -EINVAL;
+
+	for (value = args->values; value; value = value->next)
+		if (configure_elf64_symbol(args, elf, value))
+			return -ENAVAIL;
+
+	return 0;
+}
+
+static int resolve_elf64_note(struct elfconf_elf64file *elf, char *name, struct elfconf_checksum *csum) {
+	const unsigned char *ident = elf->head, *note;
+	struct elfconf_debug order = { .msb = ident[EI_DATA] == ELFDATA2MSB };
+	Elf64_Shdr *section;
+	uint32_t namesz;
+
+	section = find_elf64_section_header(elf, name);
+	if (!section || section->sh_type != SHT_NOTE)
+		return -ENAVAIL;
+
+	if (section->sh_size < sizeof(Elf64_Nhdr))
+		return -EINVAL;
+
+	/* The digest is the descriptor of the first note, in the byte order of the ELF */
+	note = elf->head + section->sh_offset;
+	namesz = dwarf_read(&order, &note, 4);
+	if (namesz > section->sh_size)
+		return -EINVAL;
+
+	csum->hoff = section->sh_offset + sizeof(Elf64_Nhdr) + ((namesz + 3) & ~3);
+	csum->hsize = dwarf_read(&order, &note, 4);
+
+	if (csum->hoff + csum->hsize > section->sh_offset + section->sh_size)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int resolve_elf64_checksum(struct elfconf_arguments *args, struct elfconf_elf64file *elf,
+		struct elfconf_checksum *csum) {
+	Elf64_Shdr *section;
+	Elf64_Sym *symbol;
+	int ret;
+
+	if (csum->type == ELFCONF_CHECKSUM_BUILDID) {
+		/* The build-id covers the whole file */
+		csum->offset = 0;
+		csum->size = args->size;
+
+		ret = resolve_elf64_note(elf, ELFCONF_SECTION_BUILDID, csum);
+		if (ret)
+			return ret;
+
+		/* Truncated SHA-256, so the length of the build-id is kept */
+		if (csum->hsize > sizeof(csum->digest))
+			csum->hsize = sizeof(csum->digest);
+
+		return 0;
+	}
+
+	section = find_elf64_section_header(elf, csum->section);
+	if (!section)
+		return -ENOENT;
+
+	if (section->sh_type == SHT_NOBITS)
+		return -ENODATA;
+
+	csum->offset = section->sh_offset;
+	csum->size = section->sh_size;
+
+	if (csum->type == ELFCONF_CHECKSUM_SHA256) {
+		ret = resolve_elf64_note(elf, csum->target, csum);
+		if (ret)
+			return ret;
+
+		if (csum->hsize < 32)
+			return -ERANGE;
+
+		csum->hsize = 32;
+
+		return 0;
+	}
+
+	symbol = find_elf64_symbol(elf, csum->target, 0);
+	if (!symbol)
+		return -ENAVAIL;
+
+	if (symbol->st_size < 4)
+		return -ERANGE;
+
+	/* The CRC has to be stored in the file */
+	if (symbol->st_shndx >= SHN_LORESERVE)
+		return -ENODATA;
+
+	section = elf_section_header(elf, symbol->st_shndx);
+	if (section->sh_type == SHT_NOBITS)
+		return -ENODATA;
+
+	csum->hoff = elf_symbol_offset(elf, symbol);
+	csum->hsize = 4;
+
+	return 0;
+}
+
+/*
+ * Objects in the search paths can be anything: section headers and
+ * sections have to lie within the file, and section names have to be
+ * terminated, before any of them is used.
+ */
+static int check_elf64_file(void *buf, size_t size) {
+	Elf64_Ehdr *ehdr = buf;
+	Elf64_Shdr *shdr, *names;
+	unsigned int shndx;
+
+	if (size < sizeof(*ehdr) || ehdr->e_ident[EI_DATA] != ELFCONF_HOST_DATA ||
+		ehdr->e_shentsize != sizeof(*shdr) || ehdr->e_shstrndx >= ehdr->e_shnum ||
+		ehdr->e_shoff > size || ehdr->e_shnum * sizeof(*shdr) > size - ehdr->e_shoff)
+		return -EINVAL;
+
+	shdr = buf + ehdr->e_shoff;
+
+	for (shndx = 0; shndx < ehdr->e_shnum; shndx++) {
+		if (shdr[shndx].sh_type != SHT_NOBITS &&
+			(shdr[shndx].sh_offset > size || shdr[shndx].sh_size > size - shdr[shndx].sh_offset))
+			return -EINVAL;
+
+		if ((shdr[shndx].sh_type == SHT_SYMTAB || shdr[shndx].sh_type == SHT_DYNSYM) &&
+			shdr[shndx].sh_entsize != sizeof(Elf64_Sym))
+			return -EINVAL;
+	}
+
+	names = &shdr[ehdr->e_shstrndx];
+	if (names->sh_type == SHT_NOBITS || !names->sh_size ||
+		((char *)buf)[names->sh_offset + names->sh_size - 1])
+		return -EINVAL;
+
+	for (shndx = 0; shndx < ehdr->e_shnum; shndx++)
+		if (shdr[shndx].sh_name >= names->sh_size)
+			return -EINVAL;
+
+	return 0;
+}
+
+static int index_elf64_symbols(struct elfconf_search *search, size_t file, void *buf, size_t size) {
+	struct elfconf_elf64file elf;
+	Elf64_Shdr *section;
+	Elf64_Sym *symbol;
+	unsigned int index;
+
+	/* Headers have been checked by check_elfconf_file(), objects without symbols define nothing */
+	if (parse_elf64_file(buf, &elf) || (void *)(elf.symtab + elf.numsyms) > buf + size)
+		return 0;
+
+	/* Symbol names are compared with strcmp() as well */
+	if (!elf.strsize || (void *)(elf.strtab + elf.strsize) > buf + size || elf.strtab[elf.strsize - 1])
+		return 0;
+
+	for (index = 0; index < elf.numsyms; index++) {
+		symbol = elf_symbol(&elf, index);
+
+		/*
+		 * Only symbols with contents in the object can be configured,
+		 * which also skips the symbols of separate debug files.
+		 */
+		if (symbol->st_shndx == SHN_UNDEF || symbol->st_shndx >= elf.ehdr->e_shnum || !symbol->st_name ||
+			symbol->st_name >= elf.strsize)
+			continue;
+
+		section = elf_section_header(&elf, symbol->st_shndx);
+		if (section->sh_type == SHT_NOBITS)
+			continue;
+
+		if (add_elfconf_definition(search, file, elf_symbol_name(&elf, symbol), elf_symbol_bind(symbol)))
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static int apply_elf64_args(struct elfconf_arguments *args) {
+	struct elfconf_elf64file elf;
+	struct elfconf_checksum *csum, **pos;
+	int ret;
+
+	/* Fill up data structure */
+	if (parse_elf64_file(args->buf, &elf))
+		return -EFAULT;
+
+	/* Locate checksums before anything is written */
+	for (pos = &args->csums; (csum = *pos); ) {
+		ret = resolve_elf64_checksum(args, &elf, csum);
+		if (!ret) {
+			pos = &csum->next;
+			continue;
+		}
+
+		/* Not every object found in the search paths has all checksums */
+		if (!args->search) {
+			report_elfconf_checksum(args, csum, ret);
+			return -EFAULT;
+		}
+
+		*pos = csum->next;
+		free(csum->states);
+		free(csum);
+	}
+
+	/* Search symbols and encode their values, see store_elfconf_file() */
+	if (configure_elf64_symbols(args, &elf))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int parse_elfconf_file(struct elfconf_arguments *args) {
+	struct elfconf_ehdr *ehdr = args->buf;
+
+	/* Validate ELF signature at beginning of file */
+	if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG))
+		return -ENOTSUP;
+
+	print_elfconf_ehdr(args->elf, ehdr);
+
+	/*
+	 * Determine ELF class: 32-bit or 64-bit
+	 */
+
+	if (ehdr->e_ident[EI_CLASS] == ELFCLASS32)
+		return apply_elf32_args(args);
+
+	if (ehdr->e_ident[EI_CLASS] == ELFCLASS64)
+		return apply_elf64_args(args);
+
+	return -ENOTSUP;
+}
+
+/* Read the ELF and prepare everything to be written, without modifying it */
+static int load_elfconf_file(struct elfconf_arguments *args) {
+	void *map;
+
+	/* Open ELF file */
+	args->efp = fopen(args->elf, "rb+");
+	if (!args->efp)
+		return -EBADFD;
+
+	/* Get ELF size and modification time */
+	if (fstat(fileno(args->efp), &args->est)) {
+		clear_elfconf_file(args);
+		return -EBADFD;
+	}
+
+	if (!S_ISREG(args->est.st_mode) || !args->est.st_size) {
+		clear_elfconf_file(args);
+		return -EBADFD;
+	}
+
+	/*
+	 * Map the ELF like debug files, so that lookups in a large one only
+	 * read the pages they need. Patches go to both the mapping and the
+	 * file, see write_elfconf_file().
+	 */
+	map = mmap(NULL, args->est.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+			   fileno(args->efp), 0);
+	if (map == MAP_FAILED) {
+		clear_elfconf_file(args);
+		return -EBADFD;
+	}
+
+	args->buf = map;
+	args->size = args->est.st_size;
+
+	if (parse_elfconf_file(args)) {
+		clear_elfconf_file(args);
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
+/* Write the encoded values and update the checksums */
+static int store_elfconf_file(struct elfconf_arguments *args) {
+	struct elfconf_value *value;
+
+	for (value = args->values; value; value = value->next)
+		if (store_elfconf_value(args, value))
+			return -EBADFD;
+
+	if (update_elfconf_checksums(args))
+		return -EFAULT;
+
+	/* Close the ELF first, the cache records its modification time */
+	fclose(args->efp);
+	args->efp = NULL;
+
+	/* A missing cache only costs a full rehash on the next run */
+	save_elfconf_cache(args);
+
+	return 0;
+}
+
+static int apply_elfconf_args(struct elfconf_arguments *args) {
+	if (load_elfconf_file(args))
+		return -EFAULT;
+
+	return store_elfconf_file(args);
+}
+
+static void clear_elfconf_args(struct elfconf_arguments *args);
+
+/*
+ * Searching objects
+ *
+ * Objects are loaded in the order of -f, the libraries needed by it (-N)
+ * and the objects in the search paths, sorted by path. As with the
+ * dynamic linker, symbols exported by an object take precedence over
+ * local ones, and the first object in load order wins with -D first.
+ */
+
+static void *map_elfconf_file(const char *path, size_t *size) {
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size < EI_NIDENT) {
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	*size = st.st_size;
+
+	return map;
+}
+
+/* Append an object to the load order, unless it has been found before */
+static int add_elfconf_file(struct elfconf_search *search, const char *name) {
+	size_t *table, mask, num, i, j;
+	char *path, **files;
+
+	/* Dangling symlinks are skipped */
+	path = realpath(name, NULL);
+	if (!path)
+		return 0;
+
+	/* Keep the table of paths at most half full */
+	if (2 * (search->numfiles + 1) > search->numtable) {
+		num = search->numtable ? search->numtable * 2 : 256;
+		table = calloc(num, sizeof(*table));
+		if (!table) {
+			free(path);
+			return -ENOMEM;
+		}
+
+		for (i = 0; i < search->numfiles; i++) {
+			j = elfconf_hash(search->files[i], strlen(search->files[i]));
+			for (j &= num - 1; table[j]; j = (j + 1) & (num - 1));
+			table[j] = i + 1;
+		}
+
+		free(search->table);
+		search->table = table;
+		search->numtable = num;
+	}
+
+	mask = search->numtable - 1;
+
+	for (j = elfconf_hash(path, strlen(path)) & mask; search->table[j]; j = (j + 1) & mask) {
+		if (!strcmp(search->files[search->table[j] - 1], path)) {
+			free(path);
+			return 0;
+		}
+	}
+
+	if (search->numfiles == search->maxfiles) {
+		num = search->maxfiles ? search->maxfiles * 2 : 256;
+		files = realloc(search->files, num * sizeof(*files));
+		if (!files) {
+			free(path);
+			return -ENOMEM;
+		}
+
+		search->files = files;
+		search->maxfiles = num;
+	}
+
+	search->files[search->numfiles++] = path;
+	search->table[j] = search->numfiles;
+
+	return 0;
+}
+
+/* Add all files below a directory, symlinks to directories are not followed */
+static int scan_elfconf_dir(struct elfconf_search *search, const char *dir) {
+	struct dirent **entries;
+	char path[PATH_MAX];
+	struct stat st;
+	int i, num, ret = 0;
+
+	num = scandir(dir, &entries, NULL, alphasort);
+	if (num < 0)
+		return -ENOENT;
+
+	for (i = 0; i < num && !ret; i++) {
+		if (!strcmp(entries[i]->d_name, ".") || !strcmp(entries[i]->d_name, ".."))
+			continue;
+
+		if (snprintf(path, sizeof(path), "%s/%s", dir, entries[i]->d_name) >= (int)sizeof(path))
+			continue;
+
+		if (lstat(path, &st))
+			continue;
+
+		/* Unreadable subdirectories are skipped */
+		if (S_ISDIR(st.st_mode))
+			ret = scan_elfconf_dir(search, path) == -ENOMEM ? -ENOMEM : 0;
+		else if (S_ISREG(st.st_mode) || (S_ISLNK(st.st_mode) && !stat(path, &st) && S_ISREG(st.st_mode)))
+			ret = add_elfconf_file(search, path);
+	}
+
+	for (i = 0; i < num; i++)
+		free(entries[i]);
+
+	free(entries);
+
+	return ret;
+}
+
+/* Copy an entry of DT_RUNPATH or DT_RPATH, replacing $ORIGIN */
+static int expand_elfconf_origin(char *dst, size_t size, const char *src, size_t len, const char *object) {
+	size_t dirlen = elfconf_dirname(object) - 1, skip, n = 0;
+	const char *end = src + len;
+
+	while (src < end) {
+		if (end - src >= 7 && !strncmp(src, "$ORIGIN", 7))
+			skip = 7;
+		else if (end - src >= 9 && !strncmp(src, "${ORIGIN}", 9))
+			skip = 9;
+		else
+			skip = 0;
+
+		if (n + (skip ? dirlen : 1) >= size)
+			return -ERANGE;
+
+		if (skip) {
+			memcpy(dst + n, object, dirlen);
+			n += dirlen;
+			src += skip;
+		} else {
+			dst[n++] = *src++;
+		}
+	}
+
+	dst[n] = '\0';
+
+	return 0;
+}
+
+static int find_elfconf_needed(struct elfconf_arguments *args, struct elfconf_search *search,
+		size_t file, const char *name, const char *rpath) {
+	char path[PATH_MAX], dir[PATH_MAX];
+	size_t len, i;
+
+	/* Names with a slash are used as is */
+	if (strchr(name, '/'))
+		return add_elfconf_file(search, name);
+
+	for (; rpath && *rpath; rpath += len + !!rpath[len]) {
+		len = strcspn(rpath, ":");
+
+		if (!len || expand_elfconf_origin(dir, sizeof(dir), rpath, len, search->files[file]))
+			continue;
+
+		if (snprintf(path, sizeof(path), "%s/%s", dir, name) < (int)sizeof(path) && !access(path, F_OK))
+			return add_elfconf_file(search, path);
+	}
+
+	for (i = 0; i < args->numpaths; i++) {
+		if (snprintf(path, sizeof(path), "%s/%s", args->paths[i], name) < (int)sizeof(path) &&
+			!access(path, F_OK))
+			return add_elfconf_file(search, path);
+	}
+
+	/* System libraries are not part of the objects to be configured */
+	dprintf("elfconf: %s needed by %s not found\n", name, search->files[file]);
+
+	return 0;
+}
+
+/* ELF objects whose headers can be used, see check_elf32_file() */
+static int check_elfconf_file(void *buf, size_t size) {
+	unsigned char *ident = buf;
+
+	if (memcmp(ident, ELFMAG, SELFMAG))
+		return -ENOTSUP;
+
+	if (ident[EI_CLASS] == ELFCLASS32)
+		return check_elf32_file(buf, size);
+
+	if (ident[EI_CLASS] == ELFCLASS64)
+		return check_elf64_file(buf, size);
+
+	return -ENOTSUP;
+}
+
+/* Add the libraries in DT_NEEDED, found through DT_RUNPATH (or DT_RPATH) and -S */
+static int add_elfconf_needed(struct elfconf_arguments *args, struct elfconf_search *search, size_t file) {
+	struct elfconf_dwarf_section dynamic, dynstr;
+	const char *rpath = NULL, *runpath = NULL;
+	const unsigned char *ident;
+	unsigned long tag, val;
+	size_t size, entsize, i;
+	int pass, ret = 0;
+	void *buf;
+
+	buf = map_elfconf_file(search->files[file], &size);
+	if (!buf)
+		return 0;
+
+	ident = buf;
+	entsize = ident[EI_CLASS] == ELFCLASS32 ? sizeof(Elf32_Dyn) : sizeof(Elf64_Dyn);
+
+	/* Static executables, relocatable objects and other files need nothing */
+	if (check_elfconf_file(buf, size) ||
+		find_elfconf_section(buf, size, ELFCONF_SECTION_DYNAMIC, &dynamic) ||
+		find_elfconf_section(buf, size, ELFCONF_SECTION_DYNSTR, &dynstr)) {
+		munmap(buf, size);
+		return 0;
+	}
+
+	/* The search paths have to be known before the first library */
+	for (pass = 0; pass < 2 && !ret; pass++) {
+		for (i = 0; i + entsize <= dynamic.size && !ret; i += entsize) {
+			if (entsize == sizeof(Elf32_Dyn)) {
+				tag = ((const Elf32_Dyn *)(dynamic.data + i))->d_tag;
+				val = ((const Elf32_Dyn *)(dynamic.data + i))->d_un.d_val;
+			} else {
+				tag = ((const Elf64_Dyn *)(dynamic.data + i))->d_tag;
+				val = ((const Elf64_Dyn *)(dynamic.data + i))->d_un.d_val;
+			}
+
+			if (tag == DT_NULL)
+				break;
+
+			if (val >= dynstr.size)
+				continue;
+
+			if (!pass && tag == DT_RUNPATH)
+				runpath = (const char *)dynstr.data + val;
+			else if (!pass && tag == DT_RPATH)
+				rpath = (const char *)dynstr.data + val;
+			else if (pass && tag == DT_NEEDED)
+				ret = find_elfconf_needed(args, search, file, (const char *)dynstr.data + val,
+										  runpath ? runpath : rpath);
+		}
+	}
+
+	munmap(buf, size);
+
+	return ret;
+}
+
+static int index_elfconf_file(struct elfconf_search *search, size_t file) {
+	unsigned char *ident;
+	size_t size;
+	void *buf;
+	int ret = 0;
+
+	buf = map_elfconf_file(search->files[file], &size);
+	if (!buf)
+		return 0;
+
+	/* Anything else in the search paths is ignored */
+	ident = buf;
+	if (!check_elfconf_file(buf, size)) {
+		if (ident[EI_CLASS] == ELFCLASS32)
+			ret = index_elf32_symbols(search, file, buf, size);
+		else
+			ret = index_elf64_symbols(search, file, buf, size);
+	}
+
+	munmap(buf, size);
+
+	return ret;
+}
+
+static void *index_elfconf_worker(void *ptr) {
+	struct elfconf_search *search = ptr;
+	size_t file;
+
+	while ((file = __atomic_fetch_add(&search->next, 1, __ATOMIC_RELAXED)) < search->numfiles)
+		if (index_elfconf_file(search, file))
+			__atomic_store_n(&search->error, -ENOMEM, __ATOMIC_RELAXED);
+
+	return NULL;
+}
+
+static int index_elfconf_files(struct elfconf_search *search) {
+	pthread_t *threads;
+	long num, i;
+
+	num = sysconf(_SC_NPROCESSORS_ONLN);
+	if (num > (long)search->numfiles)
+		num = search->numfiles;
+
+	if (num < 1)
+		num = 1;
+
+	threads = calloc(num, sizeof(*threads));
+	if (!threads)
+		return -ENOMEM;
+
+	/* The calling thread takes part, so missing threads only cost time */
+	for (i = 1; i < num; i++)
+		if (pthread_create(&threads[i], NULL, index_elfconf_worker, search))
+			break;
+
+	index_elfconf_worker(search);
+
+	while (--i > 0)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+
+	return search->error;
+}
+
+/* Apply the policy for duplicates to the definitions of a symbol */
+static int select_elfconf_definitions(struct elfconf_arguments *args, struct elfconf_search *search,
+		struct elfconf_name *slot) {
+	struct elfconf_definition *def, **pos;
+	int exported = 0, count = 0;
+
+	for (def = slot->defs; def; def = def->next)
+		exported |= def->bind != STB_LOCAL;
+
+	/* Local symbols only count if no object exports the symbol */
+	for (pos = &slot->defs; (def = *pos); ) {
+		if ((exported && def->bind == STB_LOCAL) || (count && args->duplicates == ELFCONF_DUPLICATES_FIRST)) {
+			*pos = def->next;
+			free(def);
+			continue;
+		}
+
+		pos = &def->next;
+		count++;
+	}
+
+	if (!count) {
+		fprintf(stderr, "elfconf: %.*s is not defined in any object\n", (int)slot->len, slot->name);
+		return -ENAVAIL;
+	}
+
+	if (count > 1 && args->duplicates == ELFCONF_DUPLICATES_ERROR) {
+		fprintf(stderr, "elfconf: %.*s is defined in multiple objects:\n", (int)slot->len, slot->name);
+		for (def = slot->defs; def; def = def->next)
+			fprintf(stderr, "  %s\n", search->files[def->file]);
+
+		return -EEXIST;
+	}
+
+	for (def = slot->defs; def; def = def->next)
+		dprintf("elfconf: %.*s defined in %s\n", (int)slot->len, slot->name, search->files[def->file]);
+
+	return 0;
+}
+
+static void free_elfconf_object(struct elfconf_arguments *object) {
+	if (!object)
+		return;
+
+	clear_elfconf_file(object);
+	clear_elfconf_args(object);
+	free(object);
+}
+
+/*
+ * Load one object with copies of the values of the symbols it defines,
+ * NULL if it defines none of them.
+ */
+static int load_elfconf_object(struct elfconf_arguments *args, struct elfconf_search *search,
+		struct elfconf_name **slots, size_t file, struct elfconf_arguments **object) {
+	struct elfconf_value *value, *vcopy, **vpos;
+	struct elfconf_checksum *csum, *ccopy, **cpos;
+	struct elfconf_definition *def;
+	size_t i;
+	int ret = 0;
+
+	*object = calloc(1, sizeof(**object));
+	if (!*object)
+		return -ENOMEM;
+
+	(*object)->elf = search->files[file];
+	(*object)->search = search;
+	vpos = &(*object)->values;
+	cpos = &(*object)->csums;
+
+	for (value = args->values, i = 0; value && !ret; value = value->next, i++) {
+		for (def = slots[i]->defs; def && def->file < file; def = def->next);
+		if (!def || def->file != file)
+			continue;
+
+		/* Lists are split in place, so every object gets its own value */
+		vcopy = malloc(sizeof(*vcopy) + strlen(value->expr) + 1);
+		if (!vcopy) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		*vcopy = *value;
+		vcopy->expr = strcpy((char *)(vcopy + 1), value->expr);
+		vcopy->exported = def->bind != STB_LOCAL;
+		vcopy->next = NULL;
+		*vpos = vcopy;
+		vpos = &vcopy->next;
+	}
+
+	for (csum = args->csums; csum && (*object)->values && !ret; csum = csum->next) {
+		ccopy = malloc(sizeof(*ccopy));
+		if (!ccopy) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		*ccopy = *csum;
+		ccopy->next = NULL;
+		*cpos = ccopy;
+		cpos = &ccopy->next;
+	}
+
+	if (!(*object)->values || ret) {
+		free_elfconf_object(*object);
+		*object = NULL;
+
+		return ret;
+	}
+
+	return load_elfconf_file(*object);
+}
+
+/* Whether a checksum has been located in any of the loaded objects */
+static int find_elfconf_checksum(struct elfconf_arguments **objects, size_t num,
+		struct elfconf_checksum *csum) {
+	struct elfconf_checksum *copy;
+	size_t file;
+
+	for (file = 0; file < num; file++) {
+		if (!objects[file])
+			continue;
+
+		for (copy = objects[file]->csums; copy; copy = copy->next)
+			if (copy->type == csum->type && copy->section == csum->section && copy->target == csum->target)
+				return 1;
+	}
+
+	return 0;
+}
+
+static void clear_elfconf_search(struct elfconf_search *search) {
+	struct elfconf_definition *def;
+	size_t i;
+
+	for (i = 0; i < search->numfiles; i++)
+		free(search->files[i]);
+
+	for (i = 0; search->names && i < search->numnames; i++) {
+		while ((def = search->names[i].defs)) {
+			search->names[i].defs = def->next;
+			free(def);
+		}
+	}
+
+	for (i = 0; i < ELFCONF_INDEX_PARTITIONS; i++)
+		pthread_mutex_destroy(&search->locks[i]);
+
+	free(search->files);
+	free(search->table);
+	free(search->names);
+}
+
+static int apply_elfconf_search(struct elfconf_arguments *args) {
+	struct elfconf_search search = { 0 };
+	struct elfconf_arguments **objects = NULL;
+	struct elfconf_checksum *csum;
+	struct elfconf_name **slots;
+	struct elfconf_value *value;
+	size_t num = 0, len, base, i, file = 0;
+	int ret = 0;
+
+	for (i = 0; i < ELFCONF_INDEX_PARTITIONS; i++)
+		pthread_mutex_init(&search.locks[i], NULL);
+
+	for (value = args->values; value; value = value->next)
+		num++;
+
+	/* Room for the symbols and the base of their member paths */
+	for (search.numnames = 16; search.numnames < 4 * num; search.numnames *= 2);
+
+	search.names = calloc(search.numnames, sizeof(*search.names));
+	slots = calloc(num + 1, sizeof(*slots));
+	if (!search.names || !slots) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (value = args->values; value; value = value->next) {
+		len = strlen(value->sym);
+		base = strcspn(value->sym, ".[");
+
+		add_elfconf_name(&search, value->sym, len);
+		if (base && base < len)
+			add_elfconf_name(&search, value->sym, base);
+	}
+
+	if (args->elf) {
+		if (access(args->elf, R_OK)) {
+			ret = -ENOENT;
+			goto out;
+		}
+
+		ret = add_elfconf_file(&search, args->elf);
+	}
+
+	for (; args->needed && file < search.numfiles && !ret; file++)
+		ret = add_elfconf_needed(args, &search, file);
+
+	for (i = 0; i < args->numpaths && !ret; i++)
+		ret = scan_elfconf_dir(&search, args->paths[i]);
+
+	/* Libraries outside the search paths needed by objects inside */
+	for (; args->needed && file < search.numfiles && !ret; file++)
+		ret = add_elfconf_needed(args, &search, file);
+
+	if (ret || index_elfconf_files(&search)) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	/* Report all symbols which cannot be resolved */
+	for (value = args->values, i = 0; value; value = value->next, i++) {
+		slots[i] = get_elfconf_name(&search, value->sym);
+		if (select_elfconf_definitions(args, &search, slots[i]))
+			ret = -EFAULT;
+	}
+
+	if (ret)
+		goto out;
+
+	objects = calloc(search.numfiles + 1, sizeof(*objects));
+	if (!objects) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* Nothing is written unless all objects could be configured */
+	for (file = 0; file < search.numfiles && !ret; file++)
+		ret = load_elfconf_object(args, &search, slots, file, &objects[file]);
+
+	/* Checksums missing in some objects are fine, missing in all is not */
+	for (csum = args->csums; csum && !ret; csum = csum->next) {
+		if (find_elfconf_checksum(objects, search.numfiles, csum))
+			continue;
+
+		if (csum->type == ELFCONF_CHECKSUM_BUILDID)
+			fprintf(stderr, "elfconf: no configured object has a build-id\n");
+		else
+			fprintf(stderr, "elfconf: no configured object has the checksum %s:%s\n",
+					csum->section, csum->target);
+
+		ret = -ENAVAIL;
+	}
+
+	for (file = 0; file < search.numfiles && !ret; file++)
+		if (objects[file])
+			ret = store_elfconf_file(objects[file]);
+
+out:
+	for (file = 0; objects && file < search.numfiles; file++)
+		free_elfconf_object(objects[file]);
+
+	clear_elfconf_search(&search);
+	free(objects);
+	free(slots);
+
+	return ret;
+}
+
+/*
+ * Parsing arguments
+ */
+
+static int parse_elfconf_checksum(char *arg, struct elfconf_arguments *args) {
+	struct elfconf_checksum *csum, **pos;
+	char *section, *target = NULL;
+
+	csum = calloc(1, sizeof(*csum));
+	if (!csum)
+		return -ENOMEM;
+
+	/* Format: <type>[:<section>:<target>] */
+	section = strchr(arg, ':');
+	if (section) {
+		*section++ = '\0';
+		target = strchr(section, ':');
+		if (target)
+			*target++ = '\0';
+	}
+
+	if (!strcmp(arg, "crc32"))
+		csum->type = ELFCONF_CHECKSUM_CRC32;
+	else if (!strcmp(arg, "sha256"))
+		csum->type = ELFCONF_CHECKSUM_SHA256;
+	else if (!strcmp(arg, "build-id"))
+		csum->type = ELFCONF_CHECKSUM_BUILDID;
+
+	if (!csum->type || (csum->type == ELFCONF_CHECKSUM_BUILDID) != !target) {
+		free(csum);
+		return -EINVAL;
+	}
+
+	csum->section = section;
+	csum->target = target;
+
+	/* Keep checksums ordered, the build-id has to come last */
+	for (pos = &args->csums; *pos && (*pos)->type <= csum->type; pos = &(*pos)->next);
+
+	csum->next = *pos;
+	*pos = csum;
+
+	return 0;
+}
+
+static int parse_elfconf_width(char *arg, struct elfconf_value *value) {
+	unsigned long width = strtoul(arg, &arg, 0);
+
+	if (*arg || !width || width > 16 || (width & (width - 1)))
+		return -EINVAL;
+
+	value->width = width;
+
+	return 0;
+}
+
+static int parse_elfconf_type(char *arg, struct elfconf_value *value) {
+	if (!strcmp(arg, "u") || !strcmp(arg, "unsigned"))
+		value->type = ELFCONF_TYPE_UNSIGNED;
+	else if (!strcmp(arg, "i") || !strcmp(arg, "signed"))
+		value->type = ELFCONF_TYPE_SIGNED;
+	else if (!strcmp(arg, "f") || !strcmp(arg, "float"))
+		value->type = ELFCONF_TYPE_FLOAT;
+	else if (!strcmp(arg, "s") || !strcmp(arg, "string"))
+		value->type = ELFCONF_TYPE_STRING;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+
+static int parse_elfconf_duplicates(char *arg, struct elfconf_arguments *args) {
+	if (!strcmp(arg, "error"))
+		args->duplicates = ELFCONF_DUPLICATES_ERROR;
+	else if (!strcmp(arg, "first"))
+		args->duplicates = ELFCONF_DUPLICATES_FIRST;
+	else if (!strcmp(arg, "all"))
+		args->duplicates = ELFCONF_DUPLICATES_ALL;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+
+static int add_elfconf_paths(char *arg, struct elfconf_arguments *args) {
+	char *dir, **paths;
+
+	/* Format: <dir>[:<dir>]... */
+	for (dir = strtok(arg, ":"); dir; dir = strtok(NULL, ":")) {
+		paths = realloc(args->paths, (args->numpaths + 1) * sizeof(*paths));
+		if (!paths)
+			return -ENOMEM;
+
+		args->paths = paths;
+		args->paths[args->numpaths++] = dir;
+	}
+
+	return 0;
+}
+
+static int add_elfconf_value(char *sym, struct elfconf_arguments *args) {
+	struct elfconf_value *value, **pos;
+
+	value = calloc(1, sizeof(*value));
+	if (!value)
+		return -ENOMEM;
+
+	value->sym = sym;
+
+	/* Keep the order of the command line */
+	for (pos = &args->values; *pos; pos = &(*pos)->next);
+	*pos = value;
+
+	return 0;
+}
+
+static void clear_elfconf_args(struct elfconf_arguments *args) {
+	struct elfconf_checksum *csum;
+	struct elfconf_value *value;
+
+	while ((value = args->values)) {
+		args->values = value->next;
+		free(value->data);
+		free(value);
+	}
+
+	while ((csum = args->csums)) {
+		args->csums = csum->next;
+		free(csum->states);
+		free(csum);
+	}
+
+	free(args->paths);
+	args->paths = NULL;
+	args->numpaths = 0;
+}
+
+static int parse_elfconf_args(int argc, char *argv[], struct elfconf_arguments *args)
+{
+	static const struct option options[] = {
+		{ "help",          no_argument,       NULL, 'h' },
+		{ "file",          required_argument, NULL, 'f' },
+		{ "symbol",        required_argument, NULL, 's' },
+		{ "value",         required_argument, NULL, 'v' },
+		{ "width",         required_argument, NULL, 'w' },
+		{ "type",          required_argument, NULL, 't' },
+		{ "fill",          no_argument,       NULL, 'F' },
+		{ "checksum",      required_argument, NULL, 'c' },
+		{ "search-path",   required_argument, NULL, 'S' },
+		{ "follow-needed", no_argument,       NULL, 'N' },
+		{ "duplicates",    required_argument, NULL, 'D' },
+		{ NULL,            0,                 NULL,   0 }
+	};
+	struct elfconf_value *value;
+	int option;
+
+	/*
+	 * Options supported by elfconf:
+	 *
+	 * -h: Show usage of this program and quit.
+	 *
+	 * The following options need to be specified together:
+	 *
+	 * -f: ELF input file to be manipulated.
+	 * -s: Symbol name in ELF which we want to modify, optionally
+	 *     followed by a member path (see DWARF).
+	 * -v: The value that should be written to the symbol, either a
+	 *     number or an expression (see Expressions).
+	 *
+	 * Multiple -s/-v pairs configure multiple symbols at once.
+	 *
+	 * Optional, apply to the preceding symbol (see Values):
+	 *
+	 * -w: Width of each element in bytes (1, 2, 4, 8 or 16).
+	 * -t: Type of the value (unsigned, signed, float or string).
+	 * -F: Repeat the value across the whole symbol.
+	 *
+	 * Optional, may be specified multiple times:
+	 *
+	 * -c: Checksum to update after the symbol has been written.
+	 *
+	 * Optional, to configure the objects defining the symbols (see
+	 * Searching objects) instead of or in addition to -f:
+	 *
+	 * -S: Directories searched for objects, may be specified multiple
+	 *     times.
+	 * -N: Also search the libraries needed by the objects.
+	 * -D: Policy for symbols defined in multiple objects (error, first
+	 *     or all).
+	 */
+
+	while ((option = getopt_long(argc, argv, "hf:s:v:w:t:Fc:S:ND:", options, NULL)) != -1) {
+		for (value = args->values; value && value->next; value = value->next);
+
+		switch (option) {
+			case 'h':
+				print_elfconf_info(argv[0]);
 				return 1;
 			case 'f':
 				args->elf = optarg;
 				break;
 			case 's':
-				args->sym = optarg;
+				if (add_elfconf_value(optarg, args))
+					return -EFAULT;
 				break;
 			case 'v':
-				args->val = strtoull(optarg, NULL, 0);
+				/* Values belong to the preceding symbol */
+				if (!value || value->expr)
+					return -EFAULT;
+				value->expr = optarg;
+				break;
+			case 'w':
+				if (!value || parse_elfconf_width(optarg, value))
+					return -EFAULT;
+				break;
+			case 't':
+				if (!value || parse_elfconf_type(optarg, value))
+					return -EFAULT;
+				break;
+			case 'F':
+				if (!value)
+					return -EFAULT;
+				value->fill = 1;
+				break;
+			case 'c':
+				if (parse_elfconf_checksum(optarg, args))
+					return -EFAULT;
+				break;
+			case 'S':
+				if (add_elfconf_paths(optarg, args))
+					return -EFAULT;
+				break;
+			case 'N':
+				args->needed = 1;
+				break;
+			case 'D':
+				if (parse_elfconf_duplicates(optarg, args))
+					return -EFAULT;
 				break;
 			case '?':
 				return -EFAULT;
@@ -740,19 +5723,25 @@ static int parse_elfconf_args(int argc, char *argv[], struct elfconf_arguments *
 		}
 	}
 
+	/* Every symbol needs a value */
+	for (value = args->values; value; value = value->next)
+		if (!value->expr)
+			return -EFAULT;
+
 	return 0;
 }
 
 int main(int argc, char *argv[]) {
-	struct elfconf_arguments args;
+	struct elfconf_arguments args = { 0 };
+	int ret = 0;
 
 	if (parse_elfconf_args(argc, argv, &args))
-		return -EFAULT;
-
-	if (apply_elfconf_args(&args))
-		return -EFAULT;
+		ret = -EFAULT;
+	else if (args.numpaths || args.needed ? apply_elfconf_search(&args) : apply_elfconf_args(&args))
+		ret = -EFAULT;
 
 	clear_elfconf_file(&args);
+	clear_elfconf_args(&args);
 
-	return 0;
+	return ret;
 }